@@ -84,6 +84,9 @@ int is_safe_state(void){
 
 /* 4. HÀM XIN TÀI NGUYÊN */
 int request_resources(int request[]) {
+    if (!os_is_privileged()) {
+        return (int)os_syscall1(SYS_REQUEST_RES, request);
+    }
     PCB_t *p = current_pcb;
     if (p == NULL) return 0;
 
@@ -127,6 +130,10 @@ int request_resources(int request[]) {
 
 /* 5. HÀM TRẢ TÀI NGUYÊN */
 void release_resources(int release[]) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_RELEASE_RES, release);
+        return;
+    }
     PCB_t *p = current_pcb;
     OS_ENTER_CRITICAL();
     
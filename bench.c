@@ -0,0 +1,913 @@
+#include "bench.h"
+
+#ifdef OS_BENCH
+
+#include "process.h"
+#include "sync.h"
+#include "uart.h"
+#include "dwt.h"
+#include "memory.h"
+#include "pool.h"
+#include "ipc.h"
+#include "mpu.h"
+#include <stdint.h>
+
+#define BENCH_ITERATIONS 1000
+#define BENCH_RUNNER_PID 1
+#define BENCH_RUNNER_PRIO 6      // cao hơn mọi task phụ trợ của benchmark
+#define BENCH_HELPER_STACK_SIZE 512 // byte: task phụ chỉ spin / gọi syscall
+
+/* Biến mà runner và task phụ (unprivileged) ghi trực tiếp nằm trong OS_SHARED:
+   mọi task của benchmark được tạo với OS_CAP_SHARED */
+static volatile uint32_t bench_sink OS_SHARED; // chặn compiler bỏ vòng lặp đo
+static uint32_t bench_next_pid OS_SHARED;      // gán trong bench_create_tasks (OS_SHARED không có giá trị khởi tạo)
+static os_sem_t bench_park_sem OS_KERNEL_OBJECT(os_sem_t);      // không bao giờ được signal: chỗ "đỗ" task phụ khi xong việc
+
+static void bench_report(const char *name, uint32_t levels, uint32_t total_cycles)
+{
+    uart_print("  ");
+    uart_print(name);
+    uart_print(" @");
+    uart_print_dec(levels);
+    uart_print(" prio: ");
+    uart_print_dec(total_cycles / BENCH_ITERATIONS);
+    uart_print(" cycles\r\n");
+}
+
+/* ============================================================
+   1. CHỌN TASK ƯU TIÊN CAO NHẤT: quét tuần tự (cũ) vs CLZ (mới)
+   ============================================================ */
+/* Bản sao vòng lặp cũ của get_highest_priority_ready_task() */
+static __attribute__((noinline)) uint32_t pick_linear(uint32_t bitmap, int levels)
+{
+    for (int prio = levels - 1; prio >= 0; prio--) {
+        if (bitmap & (1UL << prio)) {
+            return prio;
+        }
+    }
+    return 0;
+}
+
+static __attribute__((noinline)) uint32_t pick_clz(uint32_t bitmap)
+{
+    return os_highest_priority(bitmap);
+}
+
+static void bench_sched_pick(void)
+{
+    static const int levels[] = {8, 16, 32};
+
+    uart_print("[BENCH] Scheduler pick (worst case: only idle ready)\r\n");
+    for (int i = 0; i < 3; i++) {
+        /* Trường hợp xấu nhất cho vòng quét: chỉ có bit 0 (idle) được set */
+        volatile uint32_t bitmap = 1UL;
+        uint32_t start, cycles;
+
+        start = dwt_get_cycles();
+        for (int n = 0; n < BENCH_ITERATIONS; n++) {
+            bench_sink = pick_linear(bitmap, levels[i]);
+        }
+        cycles = dwt_get_cycles() - start;
+        bench_report("linear", levels[i], cycles);
+
+        start = dwt_get_cycles();
+        for (int n = 0; n < BENCH_ITERATIONS; n++) {
+            bench_sink = pick_clz(bitmap);
+        }
+        cycles = dwt_get_cycles() - start;
+        bench_report("clz   ", levels[i], cycles);
+    }
+}
+
+/* Tạo task phụ cho một kịch bản (mỗi kịch bản dùng PID mới, không tái sử dụng) */
+static PCB_t* bench_spawn(void (*func)(void), uint8_t priority)
+{
+    uint32_t pid = bench_next_pid++;
+    process_create_args_t args = {
+        .entry = func, .pid = pid, .priority = priority,
+        .stack_size = BENCH_HELPER_STACK_SIZE, .caps = OS_CAP_SHARED,
+    };
+    process_create_args(&args);
+    return &pcb_table[pid];
+}
+
+/* Số lần đổi ngữ cảnh từ lúc boot: context_switch_count nằm trong RAM kernel,
+   task unprivileged đọc qua syscall */
+static uint32_t bench_switches(void)
+{
+    os_switch_stats_t stats;
+    process_get_switch_stats(&stats);
+    return stats.switches;
+}
+
+/* Task phụ không được return (không có process_exit): chặn vĩnh viễn */
+static void bench_park(void)
+{
+    while (1) {
+        sem_wait(&bench_park_sem);
+    }
+}
+
+/* Chạy bận trong `cycles` chu kỳ (thời gian thực, kể cả khi bị chiếm CPU).
+   Task chạy unprivileged: đọc DWT qua os_get_cycles() (fast-path syscall). */
+static void bench_spin(uint32_t cycles)
+{
+    uint32_t start = os_get_cycles();
+    while (os_get_cycles() - start < cycles) {
+    }
+}
+
+/* ============================================================
+   2. PRIORITY INVERSION: L (thấp) giữ mutex, M (trung bình) chạy bận,
+      H (runner, cao) chờ mutex. Đo thời gian H bị chặn.
+   ============================================================ */
+#define PI_LOW_PRIO      2
+#define PI_MED_PRIO      4
+#define PI_HOLD_CYCLES   200000UL   // L giữ mutex chừng này chu kỳ
+#define PI_MED_CYCLES    2000000UL  // M chiếm CPU chừng này chu kỳ
+
+static os_mutex_t pi_mutex OS_KERNEL_OBJECT(os_mutex_t);
+static os_sem_t pi_low_locked OS_KERNEL_OBJECT(os_sem_t);
+static os_sem_t pi_med_done OS_KERNEL_OBJECT(os_sem_t);
+
+static void pi_low_task(void)
+{
+    mutex_lock(&pi_mutex);
+    sem_signal(&pi_low_locked);
+    bench_spin(PI_HOLD_CYCLES);
+    mutex_unlock(&pi_mutex);
+    bench_park();
+}
+
+static void pi_med_task(void)
+{
+    bench_spin(PI_MED_CYCLES);
+    sem_signal(&pi_med_done);
+    bench_park();
+}
+
+static void bench_priority_inversion(uint8_t protocol, const char *name)
+{
+    mutex_init_protocol(&pi_mutex, protocol, 0);
+    sem_init(&pi_low_locked, 0);
+    sem_init(&pi_med_done, 0);
+
+    bench_spawn(pi_low_task, PI_LOW_PRIO);
+    sem_wait(&pi_low_locked);           // L đã giữ mutex
+    bench_spawn(pi_med_task, PI_MED_PRIO);
+
+    uint32_t start = os_get_cycles();
+    mutex_lock(&pi_mutex);              // H bị chặn ở đây
+    uint32_t blocked = os_get_cycles() - start;
+    mutex_unlock(&pi_mutex);
+
+    sem_wait(&pi_med_done);
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": H blocked ");
+    uart_print_dec(blocked);
+    uart_print(" cycles (L holds ");
+    uart_print_dec(PI_HOLD_CYCLES);
+    uart_print(")\r\n");
+}
+
+/* ============================================================
+   3. MUTEX TRANH CHẤP: 2 task cùng ưu tiên lock -> yield -> unlock.
+      Đếm số lần đổi ngữ cảnh cho mỗi cặp lock/unlock.
+   ============================================================ */
+#define CONTEND_PRIO    3
+#define CONTEND_ROUNDS  100
+
+static os_mutex_t contend_mutex OS_KERNEL_OBJECT(os_mutex_t);
+static os_sem_t contend_done OS_KERNEL_OBJECT(os_sem_t);
+
+static void contend_task(void)
+{
+    for (int i = 0; i < CONTEND_ROUNDS; i++) {
+        mutex_lock(&contend_mutex);
+        os_yield();                     // để task kia chạy và bị chặn ở mutex
+        mutex_unlock(&contend_mutex);
+    }
+    sem_signal(&contend_done);
+    bench_park();
+}
+
+static void bench_mutex_contention(void)
+{
+    mutex_init(&contend_mutex);
+    sem_init(&contend_done, 0);
+
+    uint32_t switches = bench_switches();
+    bench_spawn(contend_task, CONTEND_PRIO);
+    bench_spawn(contend_task, CONTEND_PRIO);
+    sem_wait(&contend_done);
+    sem_wait(&contend_done);
+    switches = bench_switches() - switches;
+
+    /* x100 để in 2 chữ số thập phân */
+    uint32_t per_pair_x100 = switches * 100 / (2 * CONTEND_ROUNDS);
+    uart_print("  ");
+    uart_print_dec(switches);
+    uart_print(" switches / ");
+    uart_print_dec(2 * CONTEND_ROUNDS);
+    uart_print(" lock-unlock pairs = ");
+    uart_print_dec(per_pair_x100 / 100);
+    uart_putc('.');
+    uart_print_dec((per_pair_x100 % 100) / 10);
+    uart_print_dec(per_pair_x100 % 10);
+    uart_print(OS_SYNC_HANDOFF ? " per pair (direct handoff)\r\n" : " per pair (wake-and-retry)\r\n");
+}
+
+/* ============================================================
+   4. BÁO SỰ KIỆN ISR -> TASK: sem_signal vs notify_give
+      a) không có task chờ (byte thứ 2, 3... của một loạt UART)
+      b) có task chờ ưu tiên cao hơn: mỗi sự kiện đánh thức nó (gồm 2 lần đổi ngữ cảnh)
+   ============================================================ */
+#define EVENT_ROUNDS      200
+#define EVENT_WAITER_PRIO (BENCH_RUNNER_PRIO + 1)
+#define EVENT_TIMEOUT_TICKS 2
+
+static os_sem_t event_sem OS_KERNEL_OBJECT(os_sem_t);
+static volatile uint32_t event_received OS_SHARED;
+
+static void event_sem_waiter(void)
+{
+    while (1) {
+        sem_wait(&event_sem);
+        event_received++;
+    }
+}
+
+static void event_notify_waiter(void)
+{
+    while (1) {
+        notify_wait(0xFFFFFFFFUL, NULL, OS_WAIT_FOREVER);
+        event_received++;
+    }
+}
+
+static void bench_event_report(const char *name, uint32_t cycles)
+{
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": ");
+    uart_print_dec(cycles / EVENT_ROUNDS);
+    uart_print(" cycles/event\r\n");
+}
+
+static void bench_event_signal(void)
+{
+    uint32_t start;
+
+    /* a) Không có task chờ */
+    sem_init(&event_sem, 0);
+    start = os_get_cycles();
+    for (int i = 0; i < EVENT_ROUNDS; i++) {
+        sem_signal(&event_sem);
+    }
+    bench_event_report("sem_signal, no waiter ", os_get_cycles() - start);
+
+    PCB_t *self = &pcb_table[BENCH_RUNNER_PID]; // current_pcb nằm trong RAM kernel
+    start = os_get_cycles();
+    for (int i = 0; i < EVENT_ROUNDS; i++) {
+        notify_give(self, 0, NOTIFY_INCREMENT);
+    }
+    bench_event_report("notify_give, no waiter", os_get_cycles() - start);
+    notify_wait(0xFFFFFFFFUL, NULL, OS_NO_WAIT); // xóa thông báo đang treo
+
+    /* Kiểm tra: không ai notify_give thì notify_wait phải hết hạn, không được trả OS_OK */
+    uint32_t value = 0;
+    uint32_t tick_start = os_get_ticks();
+    os_status_t status = notify_wait(0xFFFFFFFFUL, &value, EVENT_TIMEOUT_TICKS);
+    uint32_t waited = os_get_ticks() - tick_start;
+    uart_print((status == OS_ERR_TIMEOUT && waited >= EVENT_TIMEOUT_TICKS) ?
+               "  notify_wait timeout: OK (" : "  notify_wait timeout: FAIL (");
+    uart_print_dec(waited);
+    uart_print(" ticks)\r\n");
+
+    /* b) Có task chờ: mỗi sự kiện đánh thức waiter ưu tiên cao hơn */
+    sem_init(&event_sem, 0);
+    bench_spawn(event_sem_waiter, EVENT_WAITER_PRIO); // chạy ngay tới sem_wait rồi chặn
+    event_received = 0;
+    start = os_get_cycles();
+    for (int i = 0; i < EVENT_ROUNDS; i++) {
+        sem_signal(&event_sem);
+    }
+    bench_event_report("sem_signal, wake      ", os_get_cycles() - start);
+
+    PCB_t *waiter = bench_spawn(event_notify_waiter, EVENT_WAITER_PRIO);
+    event_received = 0;
+    start = os_get_cycles();
+    for (int i = 0; i < EVENT_ROUNDS; i++) {
+        notify_give(waiter, 0, NOTIFY_INCREMENT);
+    }
+    bench_event_report("notify_give, wake     ", os_get_cycles() - start);
+}
+
+/* ============================================================
+   5. ĐỘ TRỄ NGẮT KHI KERNEL ĐANG Ở VÙNG TỚI HẠN
+      Pend IRQ0 (mức 0x00, zero-latency) và IRQ1 (mức 0xA0, gọi được API kernel)
+      giữa một vùng tới hạn làm việc với heap, đo từ lúc pend tới lúc ISR chạy.
+      Chạy lúc boot (privileged) vì task unprivileged không ghi được BASEPRI/PRIMASK.
+   ============================================================ */
+#define NVIC_EN0       (*(volatile uint32_t*)0xE000E100)
+#define NVIC_DIS0      (*(volatile uint32_t*)0xE000E180)
+#define NVIC_ISPR0     (*(volatile uint32_t*)0xE000E200)
+#define NVIC_IPR_GPIOA (*(volatile uint8_t*)(0xE000E400 + 0))
+#define NVIC_IPR_GPIOB (*(volatile uint8_t*)(0xE000E400 + 1))
+
+#define IRQ_ROUNDS      50
+#define IRQ_HEAP_BLOCKS 8
+#define UART0_BENCH_IRQ_PRIORITY 0xA0 // cùng mức với UART0 (uart.c)
+
+static volatile uint32_t irq_pend_cycles;
+static volatile uint32_t irq_latency[2]; // [0] = IRQ0, [1] = IRQ1
+
+void GPIOPortA_Handler(void)
+{
+    irq_latency[0] = dwt_get_cycles() - irq_pend_cycles;
+}
+
+void GPIOPortB_Handler(void)
+{
+    irq_latency[1] = dwt_get_cycles() - irq_pend_cycles;
+}
+
+/* Việc "thật" trong vùng tới hạn: cấp phát rồi trả lại vài khối heap.
+   os_malloc/os_free tự vào vùng tới hạn lồng bên trong. */
+static void irq_critical_work(void)
+{
+    void *blocks[IRQ_HEAP_BLOCKS];
+
+    for (int i = 0; i < IRQ_HEAP_BLOCKS; i++) {
+        blocks[i] = os_malloc(32 + i * 16);
+    }
+    for (int i = 0; i < IRQ_HEAP_BLOCKS; i++) {
+        os_free(blocks[i]);
+    }
+}
+
+static void bench_irq_latency_run(const char *name, int use_primask)
+{
+    uint32_t worst[2] = {0, 0};
+
+    for (int n = 0; n < IRQ_ROUNDS; n++) {
+        irq_latency[0] = irq_latency[1] = 0;
+
+        if (use_primask) {
+            __asm volatile ("cpsid i" : : : "memory"); // cách cũ: tắt mọi ngắt
+        } else {
+            OS_ENTER_CRITICAL();
+        }
+
+        irq_pend_cycles = dwt_get_cycles();
+        NVIC_ISPR0 = (1UL << 0) | (1UL << 1);
+        irq_critical_work();
+
+        if (use_primask) {
+            __asm volatile ("cpsie i" : : : "memory");
+        } else {
+            OS_EXIT_CRITICAL();
+        }
+        __asm volatile ("dsb\n isb" : : : "memory");
+
+        for (int i = 0; i < 2; i++) {
+            if (irq_latency[i] > worst[i]) {
+                worst[i] = irq_latency[i];
+            }
+        }
+    }
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": IRQ0 (0x00) worst ");
+    uart_print_dec(worst[0]);
+    uart_print(" cycles, IRQ1 (0xA0) worst ");
+    uart_print_dec(worst[1]);
+    uart_print(" cycles\r\n");
+}
+
+static void bench_irq_latency(void)
+{
+    NVIC_IPR_GPIOA = 0x00;                     // trên ngưỡng: không bao giờ bị che
+    NVIC_IPR_GPIOB = UART0_BENCH_IRQ_PRIORITY; // dưới ngưỡng: như UART0
+    NVIC_EN0 |= (1UL << 0) | (1UL << 1);
+
+    uart_print("[BENCH] IRQ latency inside a kernel critical section\r\n");
+    bench_irq_latency_run("PRIMASK (cpsid i)", 1);
+    bench_irq_latency_run("BASEPRI 0x40     ", 0);
+
+    NVIC_DIS0 = (1UL << 0) | (1UL << 1);
+}
+
+/* ============================================================
+   6. CHI PHÍ SYSTEM CALL
+      Cùng một cặp sem_signal + sem_try_wait:
+      a) gọi trực tiếp lúc boot (privileged, không qua svc)
+      b) từ task unprivileged qua fast path (2 lần svc)
+      c) sem_signal fast path + sem_wait_timeout (có timeout -> thread path)
+      d) svc rỗng (SYS_NULL)
+   ============================================================ */
+#define SYSCALL_ROUNDS 500
+
+static os_sem_t syscall_sem OS_KERNEL_OBJECT(os_sem_t);
+static uint32_t syscall_direct_cycles OS_SHARED; // đo ở bước a) lúc boot, runner in cùng các bước còn lại
+
+static void bench_syscall_report(const char *name, uint32_t cycles)
+{
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": ");
+    uart_print_dec(cycles / SYSCALL_ROUNDS);
+    uart_print(" cycles\r\n");
+}
+
+static void bench_syscall_direct(void)
+{
+    sem_init(&syscall_sem, 0);
+    uint32_t start = dwt_get_cycles();
+    for (int i = 0; i < SYSCALL_ROUNDS; i++) {
+        sem_signal(&syscall_sem);
+        sem_try_wait(&syscall_sem);
+    }
+    syscall_direct_cycles = dwt_get_cycles() - start;
+}
+
+static void bench_syscall(void)
+{
+    uint32_t start;
+
+    bench_syscall_report("signal+try_wait, direct (boot)   ", syscall_direct_cycles);
+
+    start = os_get_cycles();
+    for (int i = 0; i < SYSCALL_ROUNDS; i++) {
+        sem_signal(&syscall_sem);
+        sem_try_wait(&syscall_sem);
+    }
+    bench_syscall_report("signal+try_wait, fast path       ", os_get_cycles() - start);
+
+    start = os_get_cycles();
+    for (int i = 0; i < SYSCALL_ROUNDS; i++) {
+        sem_signal(&syscall_sem);
+        sem_wait_timeout(&syscall_sem, 1); // còn đơn vị nên không chặn, nhưng đi thread path
+    }
+    bench_syscall_report("signal+wait_timeout, thread path ", os_get_cycles() - start);
+
+    start = os_get_cycles();
+    for (int i = 0; i < SYSCALL_ROUNDS; i++) {
+        os_syscall0(SYS_NULL);
+    }
+    bench_syscall_report("null syscall                     ", os_get_cycles() - start);
+}
+
+/* ============================================================
+   7. CHI PHÍ ĐỔI NGỮ CẢNH: 2 task cùng mức thay nhau os_yield()
+      Mỗi vòng = 1 syscall yield (fast path) + 1 lần PendSV (gồm nạp MPU).
+      Phần PendSV riêng đo bằng DWT ở đầu và cuối PendSV_Handler (context_switch_cycles).
+      Số "trước": make clean bench BENCH_FLAGS=-DOS_MPU_PRECOMPUTE=0
+   ============================================================ */
+#define SWITCH_ROUNDS 500
+#define SWITCH_PRIO   (BENCH_RUNNER_PRIO - 1)
+
+static os_sem_t switch_done_sem OS_KERNEL_OBJECT(os_sem_t);
+static volatile uint32_t switch_finished OS_SHARED;
+
+static void switch_pingpong_task(void)
+{
+    for (int i = 0; i < SWITCH_ROUNDS; i++) {
+        os_yield();
+    }
+    if (++switch_finished == 2) {
+        sem_signal(&switch_done_sem);
+    }
+    bench_park();
+}
+
+static void bench_context_switch(void)
+{
+    sem_init(&switch_done_sem, 0);
+    switch_finished = 0;
+
+    // Ưu tiên thấp hơn runner: chỉ chạy khi runner chặn ở sem_wait
+    bench_spawn(switch_pingpong_task, SWITCH_PRIO);
+    bench_spawn(switch_pingpong_task, SWITCH_PRIO);
+
+    os_switch_stats_t before, after;
+    process_get_switch_stats(&before);
+    uint32_t start = os_get_cycles();
+    sem_wait(&switch_done_sem);
+    uint32_t cycles = os_get_cycles() - start;
+    process_get_switch_stats(&after);
+    uint32_t switches = after.switches - before.switches;
+
+    uart_print("  ");
+    uart_print_dec(switches);
+    uart_print(" switches, ");
+    uart_print_dec(cycles / switches);
+    uart_print(" cycles/switch (yield syscall + PendSV), ");
+    uart_print_dec((after.pendsv_cycles - before.pendsv_cycles) / switches);
+    uart_print(OS_MPU_PRECOMPUTE ? " in PendSV (precomputed MPU regions)\r\n"
+                                 : " in PendSV (regions recomputed per switch)\r\n");
+}
+
+/* ============================================================
+   8. POOL CỐ ĐỊNH vs HEAP CHUNG (lúc boot, privileged)
+      Cấp POOL_BENCH_BLOCKS block 64 byte rồi trả hết, lặp POOL_BENCH_ROUNDS lần:
+      trung bình và tệ nhất cho 1 lần cấp + 1 lần trả
+   ============================================================ */
+#define POOL_BENCH_BLOCKS 16
+#define POOL_BENCH_ROUNDS 20
+#define POOL_BENCH_SIZE   64
+
+OS_POOL_STORAGE(pool_bench_storage, POOL_BENCH_SIZE, POOL_BENCH_BLOCKS);
+static os_pool_t pool_bench OS_KERNEL_OBJECT(os_pool_t);
+
+static void bench_pool_run(const char *name, int use_pool)
+{
+    void *blocks[POOL_BENCH_BLOCKS];
+    uint32_t total = 0;
+    uint32_t worst = 0;
+
+    for (int r = 0; r < POOL_BENCH_ROUNDS; r++) {
+        for (int i = 0; i < POOL_BENCH_BLOCKS; i++) {
+            uint32_t start = dwt_get_cycles();
+            blocks[i] = use_pool ? os_pool_alloc(&pool_bench) : os_malloc(POOL_BENCH_SIZE);
+            uint32_t cycles = dwt_get_cycles() - start;
+            total += cycles;
+            if (cycles > worst) worst = cycles;
+        }
+        for (int i = 0; i < POOL_BENCH_BLOCKS; i++) {
+            uint32_t start = dwt_get_cycles();
+            if (use_pool) {
+                os_pool_free(&pool_bench, blocks[i]);
+            } else {
+                os_free(blocks[i]);
+            }
+            uint32_t cycles = dwt_get_cycles() - start;
+            total += cycles;
+            if (cycles > worst) worst = cycles;
+        }
+    }
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": avg ");
+    uart_print_dec(total / (2 * POOL_BENCH_BLOCKS * POOL_BENCH_ROUNDS));
+    uart_print(" cycles/op, worst ");
+    uart_print_dec(worst);
+    uart_print("\r\n");
+}
+
+/* Kiểm tra: liên kết block rỗi bị ghi đè (như task ghi vào pool OS_SHARED) không
+   được làm alloc trả con trỏ ngoài pool; trả 2 lần không được làm 2 lần alloc
+   sau đưa ra cùng một block */
+static void bench_pool_check(void)
+{
+    os_pool_block_t *a = os_pool_alloc(&pool_bench);
+    os_pool_free(&pool_bench, a); // a thành đỉnh danh sách rỗi
+    os_pool_block_t *saved = a->next;
+    a->next = (os_pool_block_t *)&tick_count;
+    void *got = os_pool_alloc(&pool_bench);
+    a->next = saved;
+    uart_print(got == NULL ? "  corrupted free link: OK\r\n" : "  corrupted free link: FAIL\r\n");
+
+    a = os_pool_alloc(&pool_bench);
+    uint32_t used = pool_bench.used;
+    os_pool_free(&pool_bench, a);
+    os_pool_free(&pool_bench, a);
+    uint32_t used_after = pool_bench.used;
+    void *x = os_pool_alloc(&pool_bench);
+    void *y = os_pool_alloc(&pool_bench);
+    uart_print((used_after == used - 1 && x != NULL && y != NULL && x != y) ?
+               "  double free: OK\r\n" : "  double free: FAIL\r\n");
+    os_pool_free(&pool_bench, x);
+    os_pool_free(&pool_bench, y);
+}
+
+static void bench_pool(void)
+{
+    os_pool_init(&pool_bench, "bench", pool_bench_storage, POOL_BENCH_SIZE, POOL_BENCH_BLOCKS);
+
+    uart_print("[BENCH] 64-byte blocks, fixed-size pool vs heap\r\n");
+    bench_pool_run("os_malloc/os_free      ", 0);
+    bench_pool_run("os_pool_alloc/pool_free", 1);
+    bench_pool_check();
+}
+
+/* ============================================================
+   9. THÔNG LƯỢNG HÀNG ĐỢI: frame ZC_FRAME_BYTES byte từ task phụ sang runner
+      a) os_msg_queue_t: copy từng int32_t (frame / 4 lần send + receive)
+      b) os_buf_queue_t: buffer lấy từ pool, chỉ chuyển descriptor
+      Cả hai phía đều đọc/ghi toàn bộ frame (điền dữ liệu, tính checksum).
+      Một task phụ làm cả 2 pha liên tiếp để tiết kiệm PID.
+   ============================================================ */
+#define ZC_FRAMES       64
+#define ZC_FRAME_BYTES  256
+#define ZC_FRAME_WORDS  (ZC_FRAME_BYTES / 4)
+#define ZC_POOL_BLOCKS  4
+#define ZC_PRODUCER_PRIO (BENCH_RUNNER_PRIO - 1) // chỉ chạy khi runner chặn ở receive
+
+static os_msg_queue_t zc_copy_queue OS_KERNEL_OBJECT(os_msg_queue_t);
+static os_buf_queue_t zc_buf_queue OS_KERNEL_OBJECT(os_buf_queue_t);
+static os_pool_t zc_frame_pool OS_KERNEL_OBJECT(os_pool_t);
+OS_POOL_STORAGE_SHARED(zc_frame_storage, ZC_FRAME_BYTES, ZC_POOL_BLOCKS); // producer ghi, runner đọc payload
+static uint32_t zc_src_frame[ZC_FRAME_WORDS] OS_SHARED;
+
+static void zc_fill(uint32_t *frame, uint32_t seq)
+{
+    for (int i = 0; i < ZC_FRAME_WORDS; i++) {
+        frame[i] = seq + i;
+    }
+}
+
+static void zc_producer_task(void)
+{
+    for (uint32_t n = 0; n < ZC_FRAMES; n++) {
+        zc_fill(zc_src_frame, n);
+        for (int i = 0; i < ZC_FRAME_WORDS; i++) {
+            msg_queue_send(&zc_copy_queue, (int32_t)zc_src_frame[i]);
+        }
+    }
+
+    for (uint32_t n = 0; n < ZC_FRAMES; n++) {
+        uint32_t *buf;
+        while ((buf = buf_queue_alloc(&zc_buf_queue)) == NULL) {
+            os_delay(1); // pool hết: runner chưa trả buffer
+        }
+        zc_fill(buf, n);
+        buf_queue_send(&zc_buf_queue, buf, ZC_FRAME_BYTES, OS_WAIT_FOREVER);
+    }
+    bench_park();
+}
+
+static void bench_zc_report(const char *name, uint32_t cycles)
+{
+    // Quy ra us trước để khỏi chia 64 bit (build -nostdlib, không có libgcc)
+    uint32_t kbytes = ZC_FRAMES * ZC_FRAME_BYTES / 1024;
+    uint32_t us = cycles / (OS_CPU_CLOCK_HZ / 1000000);
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": ");
+    uart_print_dec(us ? kbytes * 1000000 / us : 0);
+    uart_print(" KB/s, ");
+    uart_print_dec(cycles / ZC_FRAMES);
+    uart_print(" cycles/frame\r\n");
+}
+
+static void bench_zero_copy(void)
+{
+    uint32_t frame[ZC_FRAME_WORDS];
+    uint32_t start;
+
+    bench_spawn(zc_producer_task, ZC_PRODUCER_PRIO);
+
+    start = os_get_cycles();
+    for (uint32_t n = 0; n < ZC_FRAMES; n++) {
+        for (int i = 0; i < ZC_FRAME_WORDS; i++) {
+            frame[i] = (uint32_t)msg_queue_receive(&zc_copy_queue);
+        }
+        for (int i = 0; i < ZC_FRAME_WORDS; i++) {
+            bench_sink += frame[i];
+        }
+    }
+    bench_zc_report("copy, int32 msg_queue", os_get_cycles() - start);
+
+    start = os_get_cycles();
+    for (uint32_t n = 0; n < ZC_FRAMES; n++) {
+        uint32_t *buf;
+        uint32_t size;
+        buf_queue_receive(&zc_buf_queue, (void **)&buf, &size, OS_WAIT_FOREVER);
+        for (uint32_t i = 0; i < size / 4; i++) {
+            bench_sink += buf[i];
+        }
+        buf_queue_release(&zc_buf_queue, buf);
+    }
+    bench_zc_report("zero-copy buf_queue  ", os_get_cycles() - start);
+}
+
+/* ============================================================
+   10. HÀNG ĐỢI 1 PRODUCER / 1 CONSUMER: đường mutex + semaphore vs SPSC
+       Producer cùng mức ưu tiên với runner: mỗi bên chạy tới khi phải chặn,
+       đúng kiểu task_sensor_update -> task_display. Đo ở phía consumer.
+   ============================================================ */
+#define SPSC_MSGS          1000
+#define SPSC_PRODUCER_PRIO BENCH_RUNNER_PRIO
+
+static os_msg_queue_t spsc_locked_queue OS_KERNEL_OBJECT(os_msg_queue_t);
+static os_msg_queue_t spsc_queue OS_SHARED; // SPSC: producer và runner đọc ghi trực tiếp
+
+static void spsc_producer_task(void)
+{
+    for (int32_t i = 0; i < SPSC_MSGS; i++) {
+        msg_queue_send(&spsc_locked_queue, i);
+    }
+    for (int32_t i = 0; i < SPSC_MSGS; i++) {
+        msg_queue_send(&spsc_queue, i);
+    }
+    bench_park();
+}
+
+static void bench_spsc_run(const char *name, os_msg_queue_t *q)
+{
+    uint32_t switches = bench_switches();
+    uint32_t start = os_get_cycles();
+    for (int i = 0; i < SPSC_MSGS; i++) {
+        bench_sink += (uint32_t)msg_queue_receive(q);
+    }
+    uint32_t cycles = os_get_cycles() - start;
+    uint32_t us = cycles / (OS_CPU_CLOCK_HZ / 1000000);
+    switches = bench_switches() - switches;
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print(": ");
+    uart_print_dec(us ? SPSC_MSGS * 1000000UL / us : 0);
+    uart_print(" msg/s, ");
+    uart_print_dec(cycles / SPSC_MSGS);
+    uart_print(" cycles/msg, ");
+    uart_print_dec(switches);
+    uart_print(" switches\r\n");
+}
+
+/* Kiểm tra: producer đã xong nên hàng đợi SPSC rỗng, nhận phải hết hạn đúng hạn.
+   Thông báo thừa gửi trước làm lần chờ đầu tiên trả về sớm: lần chờ lại chỉ được
+   chờ phần timeout còn lại. */
+static void bench_spsc_timeout_check(const char *name, os_msg_queue_t *q, int batch)
+{
+    int32_t value = 0;
+    os_status_t status;
+
+    notify_give(&pcb_table[BENCH_RUNNER_PID], 0, NOTIFY_INCREMENT);
+    uint32_t tick_start = os_get_ticks();
+    if (batch) {
+        os_msg_batch_t one = { &value, 1, 1 };
+        status = msg_queue_receive_many(q, &one, EVENT_TIMEOUT_TICKS);
+    } else {
+        status = msg_queue_receive_timeout(q, &value, EVENT_TIMEOUT_TICKS);
+    }
+    uint32_t waited = os_get_ticks() - tick_start;
+    notify_wait(0xFFFFFFFFUL, NULL, OS_NO_WAIT); // xóa thông báo còn treo
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print((status == OS_ERR_TIMEOUT && waited >= EVENT_TIMEOUT_TICKS &&
+                waited <= EVENT_TIMEOUT_TICKS + 1) ? " timeout: OK (" : " timeout: FAIL (");
+    uart_print_dec(waited);
+    uart_print(" ticks)\r\n");
+}
+
+static void bench_spsc(void)
+{
+    PCB_t *producer = bench_spawn(spsc_producer_task, SPSC_PRODUCER_PRIO);
+    if (msg_queue_init_spsc(&spsc_queue, producer, &pcb_table[BENCH_RUNNER_PID]) != OS_OK) {
+        uart_print("  SPSC init failed\r\n");
+        return;
+    }
+
+    bench_spsc_run("mutex + semaphores", &spsc_locked_queue);
+    bench_spsc_run("SPSC lock-free    ", &spsc_queue);
+    bench_spsc_timeout_check("SPSC receive", &spsc_queue, 0);
+}
+
+/* ============================================================
+   11. GỬI / NHẬN THEO LÔ: thông lượng theo kích thước lô
+       Cùng cặp producer/consumer như mục 10; mỗi kích thước lô chuyển
+       BATCH_MSGS phần tử, lô = 1 chính là chi phí của API theo lô khi không gộp.
+   ============================================================ */
+#define BATCH_MSGS          1000 // chia hết cho mọi kích thước lô bên dưới
+#define BATCH_PRODUCER_PRIO BENCH_RUNNER_PRIO
+
+static const uint32_t batch_sizes[] = { 1, 2, 5, 10 };
+#define BATCH_SIZE_COUNT (sizeof(batch_sizes) / sizeof(batch_sizes[0]))
+
+static os_msg_queue_t batch_locked_queue OS_KERNEL_OBJECT(os_msg_queue_t);
+static os_msg_queue_t batch_spsc_queue OS_SHARED;
+
+static void batch_produce(os_msg_queue_t *q)
+{
+    int32_t items[10];
+    for (uint32_t s = 0; s < BATCH_SIZE_COUNT; s++) {
+        uint32_t size = batch_sizes[s];
+        for (uint32_t sent = 0; sent < BATCH_MSGS; sent += size) {
+            for (uint32_t i = 0; i < size; i++) {
+                items[i] = (int32_t)(sent + i);
+            }
+            os_msg_batch_t batch = { items, size, size };
+            msg_queue_send_many(q, &batch, OS_WAIT_FOREVER);
+        }
+    }
+}
+
+static void batch_producer_task(void)
+{
+    batch_produce(&batch_locked_queue);
+    batch_produce(&batch_spsc_queue);
+    bench_park();
+}
+
+static void bench_batch_run(const char *name, os_msg_queue_t *q)
+{
+    int32_t items[10];
+
+    uart_print("  ");
+    uart_print(name);
+    uart_print("\r\n");
+    for (uint32_t s = 0; s < BATCH_SIZE_COUNT; s++) {
+        uint32_t size = batch_sizes[s];
+        uint32_t switches = bench_switches();
+        uint32_t start = os_get_cycles();
+        for (uint32_t received = 0; received < BATCH_MSGS; ) {
+            os_msg_batch_t batch = { items, size, size };
+            msg_queue_receive_many(q, &batch, OS_WAIT_FOREVER);
+            received += batch.count;
+            bench_sink += (uint32_t)items[0];
+        }
+        uint32_t cycles = os_get_cycles() - start;
+        uint32_t us = cycles / (OS_CPU_CLOCK_HZ / 1000000);
+        switches = bench_switches() - switches;
+
+        uart_print("    batch ");
+        uart_print_dec(size);
+        uart_print(": ");
+        uart_print_dec(us ? BATCH_MSGS * 1000000UL / us : 0);
+        uart_print(" msg/s, ");
+        uart_print_dec(cycles / BATCH_MSGS);
+        uart_print(" cycles/msg, ");
+        uart_print_dec(switches);
+        uart_print(" switches\r\n");
+    }
+}
+
+static void bench_batch(void)
+{
+    PCB_t *producer = bench_spawn(batch_producer_task, BATCH_PRODUCER_PRIO);
+    if (msg_queue_init_spsc(&batch_spsc_queue, producer, &pcb_table[BENCH_RUNNER_PID]) != OS_OK) {
+        uart_print("  SPSC init failed\r\n");
+        return;
+    }
+
+    bench_batch_run("mutex + semaphores", &batch_locked_queue);
+    bench_batch_run("SPSC lock-free", &batch_spsc_queue);
+    bench_spsc_timeout_check("SPSC receive_many", &batch_spsc_queue, 1);
+}
+
+static void bench_runner_task(void)
+{
+    uart_print("[BENCH] Priority inversion (L=2 holds mutex, M=4 spins, H=6 waits)\r\n");
+    bench_priority_inversion(MUTEX_PROTOCOL_NONE, "no inheritance ");
+    bench_priority_inversion(MUTEX_PROTOCOL_INHERIT, "inheritance    ");
+
+    uart_print("[BENCH] Contended mutex (2 tasks, prio 3)\r\n");
+    bench_mutex_contention();
+
+    uart_print("[BENCH] Event signalling, semaphore vs task notification\r\n");
+    bench_event_signal();
+
+    uart_print("[BENCH] Context switch (2 tasks yielding)\r\n");
+    bench_context_switch();
+
+    uart_print("[BENCH] System call cost (per iteration)\r\n");
+    bench_syscall();
+
+    uart_print("[BENCH] Queue throughput, 256-byte frames\r\n");
+    bench_zero_copy();
+
+    uart_print("[BENCH] Single producer / single consumer queue\r\n");
+    bench_spsc();
+
+    uart_print("[BENCH] Batched send/receive, by batch size\r\n");
+    bench_batch();
+
+    uart_print("===== BENCHMARK DONE =====\r\n");
+    bench_park();
+}
+
+void bench_create_tasks(void)
+{
+    sem_init(&bench_park_sem, 0);
+    bench_next_pid = BENCH_RUNNER_PID + 1;
+
+    // Khởi tạo ở đây (privileged): os_pool_init không nhận lời gọi từ task
+    msg_queue_init(&zc_copy_queue);
+    msg_queue_init(&spsc_locked_queue);
+    msg_queue_init(&batch_locked_queue);
+    os_pool_init(&zc_frame_pool, "zc_frames", zc_frame_storage, ZC_FRAME_BYTES, ZC_POOL_BLOCKS);
+    buf_queue_init(&zc_buf_queue, &zc_frame_pool);
+    process_create_args_t runner = {
+        .entry = bench_runner_task, .pid = BENCH_RUNNER_PID, .priority = BENCH_RUNNER_PRIO,
+        .stack_size = STACK_SIZE * 4, .caps = OS_CAP_SHARED | OS_CAP_SYNC_INIT,
+    };
+    process_create_args(&runner);
+}
+
+void bench_run_boot(void)
+{
+    uart_print("\r\n===== MyOS BENCHMARK =====\r\n");
+    bench_sched_pick();
+    bench_irq_latency();
+    bench_syscall_direct();
+    bench_pool();
+}
+
+#endif /* OS_BENCH */
@@ -0,0 +1,8 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* Benchmark chỉ được build với `make bench` (-DOS_BENCH) */
+void bench_run_boot(void);   // các phép đo không cần scheduler, gọi từ main()
+void bench_create_tasks(void); // tạo task chạy các kịch bản cần nhiều task
+
+#endif
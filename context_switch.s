@@ -4,10 +4,17 @@
 
 .global PendSV_Handler
 .global start_first_task
+.global SVC_Handler
+.global svc_exit_stub
 
 /* External variables from C */
 .extern current_pcb
 .extern next_pcb
+.extern process_account_switch
+.extern mpu_config_for_task
+.extern mpu_loaded_pcb
+.extern context_switch_cycles
+.extern svc_dispatch
 
 .section .text
 
@@ -17,66 +24,86 @@
    ======================================== */
 .type PendSV_Handler, %function
 PendSV_Handler:
-    /* 0. Disable MPU temporarily (prevents faults during switch) */
-    LDR     r3, =0xE000ED94         /* MPU_CTRL address */
-    LDR     r2, [r3]
-    PUSH    {r2}                    /* Save MPU_CTRL state */
-    MOVS    r1, #0
-    STR     r1, [r3]                /* MPU_CTRL = 0 (disable) */
+    /* 0. r12 = DWT CYCCNT lúc vào, giữ tới bước 7 (cất cùng lr quanh lời gọi C).
+          Che các ISR gọi API kernel trong lúc đổi current_pcb
+          (0x40 = OS_MAX_SYSCALL_INTERRUPT_PRIORITY), ISR zero-latency vẫn chạy */
+    LDR     r12, =0xE0001004        /* DWT_CYCCNT */
+    LDR     r12, [r12]
+    MOVS    r0, #0x40
+    MSR     basepri, r0
     DSB
-    
+    ISB
+
     /* 1. Lấy PSP hiện tại */
     MRS     r0, psp
     CBZ     r0, load_next_task
 
-    /* 2. Lưu Context cũ */
+    /* 2. Lưu Context cũ (task vừa bị MemManage treo: PSP đã được đưa lên
+          đỉnh stack của nó, xem MemManage_Handler, nên không ghi vào guard) */
     LDR     r1, =current_pcb
     LDR     r1, [r1]
     CBZ     r1, load_next_task
     
-    STMDB   r0!, {r4-r11}
+    MRS     r2, control             /* CONTROL.nPRIV riêng cho từng task (thread-path syscall) */
+    STMDB   r0!, {r2, r4-r11}
     STR     r0, [r1]
 
 load_next_task:
     /* 3. Lấy Task tiếp theo */
     LDR     r1, =next_pcb
     LDR     r1, [r1]
-    CBZ     r1, restore_mpu_and_exit
+    CBZ     r1, pend_exit
     
-    PUSH    {r1}                    /* Save next_pcb */
-    LDR     r4, [r1]                /* r4 = next_pcb->stack_ptr */
-    
-    /* 4. Config MPU cho task mới */
+    /* 4. Thống kê CPU cho task cũ.
+          lr (EXC_RETURN) được cất cùng next_pcb vì BL ghi đè lr, r0 chỉ để MSP căn 8 byte */
+    PUSH    {r0, r1, r12, lr}
     MOV     r0, r1
-    BL      mpu_config_for_task     /* MPU re-enabled inside this function */
-    
-    POP     {r1}
+    BL      process_account_switch  /* cộng chu kỳ DWT cho task cũ */
+    POP     {r0, r1, r12, lr}
+
+    /* 4b. MPU region 1/2/6/7: 8 word tính sẵn ở PCB+4 -> MPU_RBAR, RASR, RBAR_A1 .. RASR_A3.
+           RBAR mang VALID|REGION nên không cần MPU_RNR. Bỏ qua nếu MPU đang giữ
+           đúng region của task này. r4-r11 còn trống: context cũ đã cất, mới chưa nạp. */
+    LDR     r2, =mpu_loaded_pcb
+    LDR     r3, [r2]
+    CMP     r3, r1
+    BEQ     mpu_done
+    STR     r1, [r2]
+    ADDS    r3, r1, #4
+    LDMIA   r3, {r4-r11}
+    LDR     r3, =0xE000ED9C         /* MPU_RBAR */
+    STMIA   r3, {r4-r11}
+mpu_done:
     
     /* 5. Cập nhật current_pcb */
     LDR     r2, =current_pcb
     STR     r1, [r2]
 
     /* 6. Khôi phục Context */
-    MOV     r0, r4
-    LDMIA   r0!, {r4-r11}
+    LDR     r0, [r1]                /* r0 = next_pcb->stack_ptr */
+    LDMIA   r0!, {r2, r4-r11}
     MSR     psp, r0
+    MSR     control, r2
     
     DSB
     ISB
 
+    /* 7. Chu kỳ của riêng PendSV (không gồm syscall/ISR đã pend nó) -> context_switch_cycles.
+          r0-r3 tự do: phần cứng khôi phục chúng khi exception return */
+    LDR     r0, =0xE0001004
+    LDR     r0, [r0]
+    SUB     r0, r0, r12
+    LDR     r2, =context_switch_cycles
+    LDR     r3, [r2]
+    ADD     r3, r3, r0
+    STR     r3, [r2]
+
 pend_exit:
+    MOVS    r0, #0
+    MSR     basepri, r0
     ORR     lr, lr, #0x04
     BX      lr
 
-restore_mpu_and_exit:
-    /* Restore MPU nếu không có task */
-    POP     {r2}
-    LDR     r3, =0xE000ED94
-    STR     r2, [r3]
-    DSB
-    ISB
-    B       pend_exit
-
 /* ========================================
    HÀM: start_first_task
    Mô tả: Khởi động task đầu tiên.
@@ -92,7 +119,7 @@ start_first_task:
 
     /* 2. Load stack pointer */
     LDR     r1, [r0]                /* r1 = task->stack_ptr */
-    ADD     r1, r1, #32             /* Skip fake R4-R11 (8*4 = 32 bytes) */
+    ADD     r1, r1, #36             /* Skip fake CONTROL + R4-R11 (9*4 = 36 bytes) */
     MSR     psp, r1
 
     /* 3. Switch to Unprivileged + PSP */
@@ -103,3 +130,28 @@ start_first_task:
     /* 4. Return to Thread mode với PSP */
     LDR     lr, =0xFFFFFFFD
     BX      lr
+
+/* ========================================
+   HÀM: SVC_Handler
+   Mô tả: Lấy số hiệu syscall từ lệnh svc (byte thấp của lệnh 16 bit ngay trước
+   PC đã cất), gọi svc_dispatch(frame, number). Tham số nằm trong khung stack.
+   ======================================== */
+.type SVC_Handler, %function
+SVC_Handler:
+    TST     lr, #4
+    ITE     EQ
+    MRSEQ   r0, msp
+    MRSNE   r0, psp
+    LDR     r1, [r0, #24]           /* stacked PC */
+    LDRB    r1, [r1, #-2]           /* imm8 của lệnh svc */
+    B       svc_dispatch            /* svc_dispatch return bằng lr = EXC_RETURN */
+
+/* ========================================
+   HÀM: svc_exit_stub
+   Mô tả: Hàm kernel của thread-path syscall return về đây (privileged Thread mode),
+   r0 = kết quả. SYS_EXIT (= 0) hạ quyền và quay về ngay sau lệnh svc gốc.
+   ======================================== */
+.type svc_exit_stub, %function
+svc_exit_stub:
+    SVC     #0
+    B       .                       /* không bao giờ tới đây */
@@ -0,0 +1,122 @@
+#include "critprof.h"
+#include "process.h"
+#include "uart.h"
+#include "dwt.h"
+
+static os_crit_site_t *site_list = NULL;        // các chỗ gọi đã từng chạy
+static os_crit_site_t *volatile active_site = NULL;
+static uint32_t active_start;
+
+/* Vùng tới hạn của task unprivileged không ghi được BASEPRI (không che gì)
+   và cũng không đọc được DWT -> bỏ qua, không đo */
+void crit_profile_begin(os_crit_site_t *site)
+{
+    if (!os_is_privileged()) {
+        active_site = NULL;
+        return;
+    }
+
+    if (!site->registered) {
+        site->registered = 1;
+        site->next = site_list;
+        site_list = site;
+    }
+    active_site = site;
+    active_start = dwt_get_cycles();
+}
+
+void crit_profile_end(void)
+{
+    os_crit_site_t *site = active_site;
+    if (site == NULL) {
+        return;
+    }
+
+    uint32_t cycles = dwt_get_cycles() - active_start;
+    uint32_t bucket = (cycles > 1) ? os_highest_priority(cycles) : 0; // floor(log2)
+    if (bucket >= OS_CRIT_HIST_BUCKETS) {
+        bucket = OS_CRIT_HIST_BUCKETS - 1;
+    }
+
+    site->count++;
+    site->hist[bucket]++;
+    if (cycles > site->max_cycles) {
+        site->max_cycles = cycles;
+    }
+    active_site = NULL;
+}
+
+void crit_profile_reset(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_IRQOFF_RESET);
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    for (os_crit_site_t *s = site_list; s != NULL; s = s->next) {
+        s->count = 0;
+        s->max_cycles = 0;
+        for (int i = 0; i < OS_CRIT_HIST_BUCKETS; i++) {
+            s->hist[i] = 0;
+        }
+    }
+    OS_EXIT_CRITICAL();
+}
+
+/* In mỗi chỗ gọi: file:line, số lần, max (chu kỳ và us), histogram log2.
+   Histogram in dạng "k:n" = n lần có độ dài trong [2^k, 2^(k+1)) chu kỳ. */
+void crit_profile_dump(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_IRQOFF_DUMP);
+        return;
+    }
+    os_crit_site_t *worst = NULL;
+
+    uart_print("Interrupts-off windows (cycles @ ");
+    uart_print_dec(OS_CPU_CLOCK_HZ / 1000000);
+    uart_print(" MHz):\r\n");
+
+    for (os_crit_site_t *s = site_list; s != NULL; s = s->next) {
+        if (s->count == 0) {
+            continue;
+        }
+        if (worst == NULL || s->max_cycles > worst->max_cycles) {
+            worst = s;
+        }
+
+        uart_print("  ");
+        uart_print(s->file);
+        uart_putc(':');
+        uart_print_dec(s->line);
+        uart_print("  n=");
+        uart_print_dec(s->count);
+        uart_print("  max=");
+        uart_print_dec(s->max_cycles);
+        uart_print("  hist");
+        for (int i = 0; i < OS_CRIT_HIST_BUCKETS; i++) {
+            if (s->hist[i] != 0) {
+                uart_putc(' ');
+                uart_print_dec(i);
+                uart_putc(':');
+                uart_print_dec(s->hist[i]);
+            }
+        }
+        uart_print("\r\n");
+    }
+
+    if (worst == NULL) {
+        uart_print("  (no samples)\r\n");
+        return;
+    }
+
+    uart_print("Worst: ");
+    uart_print(worst->file);
+    uart_putc(':');
+    uart_print_dec(worst->line);
+    uart_print(" = ");
+    uart_print_dec(worst->max_cycles);
+    uart_print(" cycles (");
+    uart_print_dec(worst->max_cycles / (OS_CPU_CLOCK_HZ / 1000000));
+    uart_print(" us)\r\n");
+}
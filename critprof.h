@@ -0,0 +1,31 @@
+#ifndef CRITPROF_H
+#define CRITPROF_H
+
+#include <stdint.h>
+
+/* Đo thời gian che ngắt của từng vùng tới hạn (OS_ENTER_CRITICAL ... OS_EXIT_CRITICAL).
+   Chỉ đo lớp ngoài cùng: đó mới là khoảng thời gian ngắt thực sự bị che. */
+#ifndef OS_CRITICAL_PROFILE
+#define OS_CRITICAL_PROFILE 1           // 0: macro vùng tới hạn không đo gì, không tốn thêm chu kỳ
+#endif
+
+#define OS_CRIT_HIST_BUCKETS 16         // bucket i: [2^i, 2^(i+1)) chu kỳ, bucket cuối gom mọi giá trị lớn hơn
+
+/* Một chỗ gọi OS_ENTER_CRITICAL(): biến static sinh ra ngay tại chỗ gọi,
+   tự đăng ký vào danh sách ở lần chạy đầu tiên */
+typedef struct os_crit_site {
+    const char *file;
+    uint16_t line;
+    uint8_t registered;
+    struct os_crit_site *next;
+    uint32_t count;                     // số lần vùng tới hạn chạy
+    uint32_t max_cycles;                // cửa sổ che ngắt dài nhất
+    uint32_t hist[OS_CRIT_HIST_BUCKETS];
+} os_crit_site_t;
+
+void crit_profile_begin(os_crit_site_t *site); // gọi ngay sau khi che ngắt (lớp ngoài cùng)
+void crit_profile_end(void);                   // gọi ngay trước khi bỏ che
+void crit_profile_reset(void);
+void crit_profile_dump(void);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef DWT_H
+#define DWT_H
+
+#include <stdint.h>
+
+/* DWT cycle counter (Cortex-M3) - dùng để đo số chu kỳ CPU */
+#define DEMCR           (*(volatile uint32_t*)0xE000EDFC) // Debug Exception and Monitor Control
+#define DWT_CTRL        (*(volatile uint32_t*)0xE0001000) // thanh ghi điều khiển DWT
+#define DWT_CYCCNT      (*(volatile uint32_t*)0xE0001004) // bộ đếm chu kỳ
+
+#define DEMCR_TRCENA_Msk        (1UL << 24) // bật khối DWT/ITM
+#define DWT_CTRL_CYCCNTENA_Msk  (1UL << 0)  // bật bộ đếm chu kỳ
+
+/* Gọi một lần ở chế độ privileged (main) trước khi đo */
+static inline void dwt_init(void)
+{
+    DEMCR |= DEMCR_TRCENA_Msk;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static inline uint32_t dwt_get_cycles(void)
+{
+    return DWT_CYCCNT;
+}
+
+#endif
@@ -1,16 +1,182 @@
 #include "ipc.h"
 
+#define SPSC_INDEX_RANGE (2 * MAX_MESSAGE_COUNT)
+
+static inline void ipc_dmb(void)
+{
+    __asm volatile ("dmb" : : : "memory");
+}
+
 void msg_queue_init(os_msg_queue_t *q){
     q->head = 0;
     q->tail = 0;
+    q->spsc = 0;
 
     mutex_init(&q->mutex_lock); // Khởi tạo mutex
     sem_init(&q->sem_data, 0); // Ban đầu không có dữ liệu
     sem_init(&q->sem_space, MAX_MESSAGE_COUNT); // Ban đầu có chỗ trống đầy đủ
 }
 
-void msg_queue_send(os_msg_queue_t *q, int32_t data){
-    sem_wait(&q->sem_space); // Chờ có chỗ trống
+os_status_t msg_queue_init_spsc(os_msg_queue_t *q, PCB_t *producer, PCB_t *consumer){
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall3(SYS_MSG_INIT_SPSC, q, producer, consumer);
+    }
+    // Hai phía đọc ghi q trực tiếp (unprivileged): q phải nằm trong vùng cả hai cùng thấy
+    if (!os_is_shared(q, sizeof(*q)) ||
+        !(producer->caps & OS_CAP_SHARED) || !(consumer->caps & OS_CAP_SHARED)) {
+        return OS_ERR_PARAM;
+    }
+    msg_queue_init(q);
+    q->spsc_receiver_waiting = 0;
+    q->spsc_sender_waiting = 0;
+    q->spsc_head = 0;
+    q->spsc_tail = 0;
+    q->producer = producer;
+    q->consumer = consumer;
+    q->spsc = 1;
+    return OS_OK;
+}
+
+/* ============================================================
+   SPSC: không khóa, không syscall khi không phải chặn.
+   Chống mất tín hiệu đánh thức: bên chờ bật cờ *_waiting, DMB, rồi kiểm tra
+   lại hàng đợi trước khi ngủ; bên kia cập nhật chỉ số, DMB, rồi mới đọc cờ.
+   Hai DMB bảo đảm ít nhất một bên thấy việc của bên kia. Thông báo thừa chỉ
+   làm bên chờ thức dậy kiểm tra lại.
+   ============================================================ */
+/* Hàng đợi ngoài OS_SHARED không bao giờ là SPSC (msg_queue_init_spsc từ chối) và
+   task unprivileged không đọc được nó: xét địa chỉ trước khi đọc q->spsc */
+static inline int spsc_mode(const os_msg_queue_t *q)
+{
+    return os_is_shared(q, sizeof(*q)) && q->spsc;
+}
+
+/* Số tick còn lại của timeout tính từ start */
+static uint32_t ipc_remaining(uint32_t start, uint32_t timeout){
+    if (timeout == OS_WAIT_FOREVER) {
+        return OS_WAIT_FOREVER;
+    }
+    uint32_t elapsed = os_get_ticks() - start;
+    return (elapsed < timeout) ? timeout - elapsed : OS_NO_WAIT;
+}
+
+/* Như ipc_remaining nhưng mốc start chỉ lấy ở lần chờ đầu tiên: đường nhanh
+   không tốn syscall đọc tick. Thông báo thừa làm notify_wait trả OS_OK sớm nên
+   mỗi lần chờ lại phải trừ thời gian đã chờ, không được bắt đầu lại từ đầu. */
+static uint32_t spsc_remaining(uint32_t *start, int *started, uint32_t timeout){
+    if (timeout == OS_NO_WAIT || timeout == OS_WAIT_FOREVER) {
+        return timeout;
+    }
+    if (!*started) {
+        *start = os_get_ticks();
+        *started = 1;
+    }
+    return ipc_remaining(*start, timeout);
+}
+
+static inline uint32_t spsc_count(uint32_t head, uint32_t tail)
+{
+    return (head + SPSC_INDEX_RANGE - tail) % SPSC_INDEX_RANGE;
+}
+
+static inline uint32_t spsc_next(uint32_t index)
+{
+    return (index + 1 == SPSC_INDEX_RANGE) ? 0 : index + 1;
+}
+
+/* Phía kia đang chờ và điều kiện của nó đã đủ: đánh thức đúng một lần */
+static inline void spsc_wake_consumer(os_msg_queue_t *q, uint32_t head){
+    uint32_t need = q->spsc_receiver_waiting;
+    if (need != 0 && spsc_count(head, q->spsc_tail) >= need) {
+        notify_give(q->consumer, 0, NOTIFY_SET_BITS);
+    }
+}
+
+static inline void spsc_wake_producer(os_msg_queue_t *q, uint32_t tail){
+    uint32_t need = q->spsc_sender_waiting;
+    if (need != 0 && MAX_MESSAGE_COUNT - spsc_count(q->spsc_head, tail) >= need) {
+        notify_give(q->producer, 0, NOTIFY_SET_BITS);
+    }
+}
+
+static os_status_t spsc_send(os_msg_queue_t *q, int32_t data, uint32_t timeout){
+    uint32_t head = q->spsc_head;
+    uint32_t start = 0;
+    int started = 0;
+
+    while (spsc_count(head, q->spsc_tail) == MAX_MESSAGE_COUNT) {
+        uint32_t remaining = spsc_remaining(&start, &started, timeout);
+        if (remaining == OS_NO_WAIT) {
+            return (timeout == OS_NO_WAIT) ? OS_ERR_WOULD_BLOCK : OS_ERR_TIMEOUT;
+        }
+        q->spsc_sender_waiting = 1;
+        ipc_dmb();
+        if (spsc_count(head, q->spsc_tail) != MAX_MESSAGE_COUNT) {
+            q->spsc_sender_waiting = 0;
+            break;
+        }
+        os_status_t status = notify_wait(0xFFFFFFFFUL, NULL, remaining);
+        q->spsc_sender_waiting = 0;
+        if (status != OS_OK) {
+            return status;
+        }
+    }
+
+    q->buffer[head % MAX_MESSAGE_COUNT] = data;
+    ipc_dmb();                      // dữ liệu phải thấy được trước chỉ số
+    q->spsc_head = spsc_next(head);
+    ipc_dmb();                      // ghi head trước khi đọc cờ chờ của consumer
+
+    spsc_wake_consumer(q, q->spsc_head);
+    return OS_OK;
+}
+
+static os_status_t spsc_receive(os_msg_queue_t *q, int32_t *data, uint32_t timeout){
+    uint32_t tail = q->spsc_tail;
+    uint32_t start = 0;
+    int started = 0;
+
+    while (spsc_count(q->spsc_head, tail) == 0) {
+        uint32_t remaining = spsc_remaining(&start, &started, timeout);
+        if (remaining == OS_NO_WAIT) {
+            return (timeout == OS_NO_WAIT) ? OS_ERR_WOULD_BLOCK : OS_ERR_TIMEOUT;
+        }
+        q->spsc_receiver_waiting = 1;
+        ipc_dmb();
+        if (spsc_count(q->spsc_head, tail) != 0) {
+            q->spsc_receiver_waiting = 0;
+            break;
+        }
+        os_status_t status = notify_wait(0xFFFFFFFFUL, NULL, remaining);
+        q->spsc_receiver_waiting = 0;
+        if (status != OS_OK) {
+            return status;
+        }
+    }
+
+    ipc_dmb();                      // đọc head trước, dữ liệu sau
+    *data = q->buffer[tail % MAX_MESSAGE_COUNT];
+    ipc_dmb();                      // đọc xong dữ liệu mới trả chỗ
+    q->spsc_tail = spsc_next(tail);
+    ipc_dmb();                      // ghi tail trước khi đọc cờ chờ của producer
+
+    spsc_wake_producer(q, q->spsc_tail);
+    return OS_OK;
+}
+
+/* Timeout chỉ áp dụng cho lúc chờ chỗ trống / chờ dữ liệu.
+   mutex_lock chỉ bảo vệ vài lệnh copy (owner được kế thừa ưu tiên) nên chờ không hạn. */
+os_status_t msg_queue_send_timeout(os_msg_queue_t *q, int32_t data, uint32_t timeout){
+    if (spsc_mode(q)) {
+        return spsc_send(q, data, timeout); // chạy ở phía gọi, tự vào kernel khi cần
+    }
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall3(SYS_MSG_SEND, q, data, timeout);
+    }
+    os_status_t status = sem_wait_timeout(&q->sem_space, timeout); // Chờ có chỗ trống
+    if (status != OS_OK) {
+        return status;
+    }
 
     mutex_lock(&q->mutex_lock); // Khóa truy cập
 
@@ -20,20 +186,333 @@ void msg_queue_send(os_msg_queue_t *q, int32_t data){
     mutex_unlock(&q->mutex_lock); // Mở khóa
 
     sem_signal(&q->sem_data); // Tăng số lượng dữ liệu
+    return OS_OK;
 }
 
-int32_t msg_queue_receive(os_msg_queue_t *q){
-    int32_t data;
-    sem_wait(&q->sem_data); // Chờ có dữ liệu
+os_status_t msg_queue_receive_timeout(os_msg_queue_t *q, int32_t *data, uint32_t timeout){
+    if (spsc_mode(q)) {
+        return spsc_receive(q, data, timeout);
+    }
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall3(SYS_MSG_RECEIVE, q, data, timeout);
+    }
+    os_status_t status = sem_wait_timeout(&q->sem_data, timeout); // Chờ có dữ liệu
+    if (status != OS_OK) {
+        return status;
+    }
 
     mutex_lock(&q->mutex_lock); // Khóa truy cập
 
-    data = q->buffer[q->tail];
+    *data = q->buffer[q->tail];
     q->tail = (q->tail + 1) % MAX_MESSAGE_COUNT;
 
     mutex_unlock(&q->mutex_lock); // Mở khóa
 
     sem_signal(&q->sem_space); // Tăng số chỗ trống
+    return OS_OK;
+}
+
+void msg_queue_send(os_msg_queue_t *q, int32_t data){
+    msg_queue_send_timeout(q, data, OS_WAIT_FOREVER);
+}
 
+int32_t msg_queue_receive(os_msg_queue_t *q){
+    int32_t data = 0;
+    msg_queue_receive_timeout(q, &data, OS_WAIT_FOREVER);
     return data;
-}
\ No newline at end of file
+}
+
+os_status_t msg_queue_try_send(os_msg_queue_t *q, int32_t data){
+    return msg_queue_send_timeout(q, data, OS_NO_WAIT);
+}
+
+os_status_t msg_queue_try_receive(os_msg_queue_t *q, int32_t *data){
+    return msg_queue_receive_timeout(q, data, OS_NO_WAIT);
+}
+
+/* ============================================================
+   GỬI / NHẬN THEO LÔ
+   Mỗi lượt: lấy hết đơn vị semaphore đang có (sem_try_wait_many), copy dưới
+   một lần mutex_lock, trả cho phía kia bằng một sem_signal_many. Chỉ chặn
+   (từng đơn vị một) khi chưa đủ min_count; đơn vị sem_wait được trao thẳng
+   thì gộp vào lượt sau.
+   ============================================================ */
+static uint32_t batch_min(const os_msg_batch_t *batch){
+    return (batch->min_count < batch->count) ? batch->min_count : batch->count;
+}
+
+static os_status_t batch_status(uint32_t done, uint32_t min, uint32_t timeout){
+    if (done >= min) {
+        return OS_OK;
+    }
+    return (timeout == OS_NO_WAIT) ? OS_ERR_WOULD_BLOCK : OS_ERR_TIMEOUT;
+}
+
+/* SPSC: copy cả lượt rồi mới công bố chỉ số một lần. Bên chờ ghi số phần tử /
+   chỗ trống còn thiếu vào *_waiting nên bên kia chỉ đánh thức khi đã đủ. */
+static os_status_t spsc_send_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout){
+    uint32_t min = batch_min(batch);
+    uint32_t start = 0;
+    int started = 0;
+    uint32_t done = 0;
+    uint32_t head = q->spsc_head;
+
+    while (1) {
+        uint32_t n = MAX_MESSAGE_COUNT - spsc_count(head, q->spsc_tail);
+        if (n > batch->count - done) {
+            n = batch->count - done;
+        }
+        if (n > 0) {
+            ipc_dmb();              // đọc tail trước khi ghi đè chỗ vừa được trả
+            for (uint32_t i = 0; i < n; i++) {
+                q->buffer[head % MAX_MESSAGE_COUNT] = batch->data[done + i];
+                head = spsc_next(head);
+            }
+            ipc_dmb();
+            q->spsc_head = head;
+            ipc_dmb();
+            spsc_wake_consumer(q, head);
+            done += n;
+        }
+        if (done >= min) {
+            break;
+        }
+
+        uint32_t remaining = spsc_remaining(&start, &started, timeout);
+        if (remaining == OS_NO_WAIT) {
+            break;
+        }
+        uint32_t need = min - done;
+        if (need > MAX_MESSAGE_COUNT) {
+            need = MAX_MESSAGE_COUNT;
+        }
+        q->spsc_sender_waiting = (uint8_t)need;
+        ipc_dmb();
+        if (MAX_MESSAGE_COUNT - spsc_count(head, q->spsc_tail) >= need) {
+            q->spsc_sender_waiting = 0;
+            continue;
+        }
+        os_status_t status = notify_wait(0xFFFFFFFFUL, NULL, remaining);
+        q->spsc_sender_waiting = 0;
+        if (status != OS_OK) {
+            break;
+        }
+    }
+
+    batch->count = done;
+    return batch_status(done, min, timeout);
+}
+
+static os_status_t spsc_receive_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout){
+    uint32_t min = batch_min(batch);
+    uint32_t start = 0;
+    int started = 0;
+    uint32_t done = 0;
+    uint32_t tail = q->spsc_tail;
+
+    while (1) {
+        uint32_t n = spsc_count(q->spsc_head, tail);
+        if (n > batch->count - done) {
+            n = batch->count - done;
+        }
+        if (n > 0) {
+            ipc_dmb();              // đọc head trước, dữ liệu sau
+            for (uint32_t i = 0; i < n; i++) {
+                batch->data[done + i] = q->buffer[tail % MAX_MESSAGE_COUNT];
+                tail = spsc_next(tail);
+            }
+            ipc_dmb();
+            q->spsc_tail = tail;
+            ipc_dmb();
+            spsc_wake_producer(q, tail);
+            done += n;
+        }
+        if (done >= min) {
+            break;
+        }
+
+        uint32_t remaining = spsc_remaining(&start, &started, timeout);
+        if (remaining == OS_NO_WAIT) {
+            break;
+        }
+        uint32_t need = min - done;
+        if (need > MAX_MESSAGE_COUNT) {
+            need = MAX_MESSAGE_COUNT;
+        }
+        q->spsc_receiver_waiting = (uint8_t)need;
+        ipc_dmb();
+        if (spsc_count(q->spsc_head, tail) >= need) {
+            q->spsc_receiver_waiting = 0;
+            continue;
+        }
+        os_status_t status = notify_wait(0xFFFFFFFFUL, NULL, remaining);
+        q->spsc_receiver_waiting = 0;
+        if (status != OS_OK) {
+            break;
+        }
+    }
+
+    batch->count = done;
+    return batch_status(done, min, timeout);
+}
+
+os_status_t msg_queue_send_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout){
+    if (spsc_mode(q)) {
+        return spsc_send_many(q, batch, timeout);
+    }
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall3(SYS_MSG_SEND_MANY, q, batch, timeout);
+    }
+    uint32_t min = batch_min(batch);
+    uint32_t start = tick_count;
+    uint32_t done = 0;
+    uint32_t granted = 0; // chỗ trống sem_wait_timeout vừa trao cho mình
+
+    while (1) {
+        uint32_t n = granted + sem_try_wait_many(&q->sem_space, batch->count - done - granted);
+        granted = 0;
+        if (n > 0) {
+            mutex_lock(&q->mutex_lock);
+            for (uint32_t i = 0; i < n; i++) {
+                q->buffer[q->head] = batch->data[done + i];
+                q->head = (q->head + 1) % MAX_MESSAGE_COUNT;
+            }
+            mutex_unlock(&q->mutex_lock);
+
+            sem_signal_many(&q->sem_data, n); // một lần đánh thức cho cả lượt
+            done += n;
+        }
+        if (done >= min) {
+            break;
+        }
+        if (sem_wait_timeout(&q->sem_space, ipc_remaining(start, timeout)) != OS_OK) {
+            break;
+        }
+        granted = 1;
+    }
+
+    batch->count = done;
+    return batch_status(done, min, timeout);
+}
+
+os_status_t msg_queue_receive_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout){
+    if (spsc_mode(q)) {
+        return spsc_receive_many(q, batch, timeout);
+    }
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall3(SYS_MSG_RECEIVE_MANY, q, batch, timeout);
+    }
+    uint32_t min = batch_min(batch);
+    uint32_t start = tick_count;
+    uint32_t done = 0;
+    uint32_t granted = 0; // phần tử sem_wait_timeout vừa trao cho mình
+
+    while (1) {
+        uint32_t n = granted + sem_try_wait_many(&q->sem_data, batch->count - done - granted);
+        granted = 0;
+        if (n > 0) {
+            mutex_lock(&q->mutex_lock);
+            for (uint32_t i = 0; i < n; i++) {
+                batch->data[done + i] = q->buffer[q->tail];
+                q->tail = (q->tail + 1) % MAX_MESSAGE_COUNT;
+            }
+            mutex_unlock(&q->mutex_lock);
+
+            sem_signal_many(&q->sem_space, n);
+            done += n;
+        }
+        if (done >= min) {
+            break;
+        }
+        if (sem_wait_timeout(&q->sem_data, ipc_remaining(start, timeout)) != OS_OK) {
+            break;
+        }
+        granted = 1;
+    }
+
+    batch->count = done;
+    return batch_status(done, min, timeout);
+}
+
+/* ============================================================
+   HÀNG ĐỢI BUFFER (zero-copy): cùng cấu trúc sem_space / mutex / sem_data
+   như msg_queue, nhưng mỗi phần tử là descriptor của một block trong pool
+   ============================================================ */
+void buf_queue_init(os_buf_queue_t *q, os_pool_t *pool){
+    q->head = 0;
+    q->tail = 0;
+    q->pool = pool;
+
+    mutex_init(&q->mutex_lock);
+    sem_init(&q->sem_data, 0);
+    sem_init(&q->sem_space, MAX_BUF_MESSAGE_COUNT);
+}
+
+void *buf_queue_alloc(os_buf_queue_t *q){
+    if (!os_is_privileged()) {
+        return (void *)os_syscall1(SYS_BUFQ_ALLOC, q);
+    }
+    return os_pool_alloc(q->pool);
+}
+
+uint32_t buf_queue_capacity(os_buf_queue_t *q){
+    if (!os_is_privileged()) {
+        return os_syscall1(SYS_BUFQ_CAPACITY, q);
+    }
+    return q->pool->block_size;
+}
+
+void buf_queue_release(os_buf_queue_t *q, void *buf){
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_BUFQ_RELEASE, q, buf);
+        return;
+    }
+    os_pool_free(q->pool, buf);
+}
+
+os_status_t buf_queue_send(os_buf_queue_t *q, void *buf, uint32_t size, uint32_t timeout){
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall4(SYS_BUFQ_SEND, q, buf, size, timeout);
+    }
+    if (size > q->pool->block_size) {
+        return OS_ERR_PARAM; // gọi lại cũng không khá hơn: không trả WOULD_BLOCK
+    }
+    os_status_t status = sem_wait_timeout(&q->sem_space, timeout);
+    if (status != OS_OK) {
+        return status;
+    }
+
+    mutex_lock(&q->mutex_lock);
+
+    q->msgs[q->head].data = buf;
+    q->msgs[q->head].size = size;
+    q->head = (q->head + 1) % MAX_BUF_MESSAGE_COUNT;
+
+    mutex_unlock(&q->mutex_lock);
+
+    sem_signal(&q->sem_data);
+    return OS_OK;
+}
+
+os_status_t buf_queue_receive(os_buf_queue_t *q, void **buf, uint32_t *size, uint32_t timeout){
+    if (!os_is_privileged()) {
+        return (os_status_t)os_syscall4(SYS_BUFQ_RECEIVE, q, buf, size, timeout);
+    }
+    os_status_t status = sem_wait_timeout(&q->sem_data, timeout);
+    if (status != OS_OK) {
+        return status;
+    }
+
+    mutex_lock(&q->mutex_lock);
+
+    *buf = q->msgs[q->tail].data;
+    if (size != NULL) {
+        *size = q->msgs[q->tail].size;
+    }
+    q->tail = (q->tail + 1) % MAX_BUF_MESSAGE_COUNT;
+
+    mutex_unlock(&q->mutex_lock);
+
+    sem_signal(&q->sem_space);
+    return OS_OK;
+}
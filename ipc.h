@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "sync.h"
+#include "pool.h"
 
 #define MAX_MESSAGE_COUNT 10
 
@@ -15,10 +16,85 @@ typedef struct{
     os_sem_t sem_data; // Số lượng dữ liệu hiện có
     os_sem_t sem_space; // Số lượng chỗ trống còn lại
 
+    /* Chế độ SPSC (msg_queue_init_spsc): không dùng mutex/semaphore ở trên.
+       Chỉ số chạy trong [0, 2 * MAX_MESSAGE_COUNT) để phân biệt rỗng/đầy;
+       mỗi biến chỉ một phía ghi nên không cần khóa. */
+    uint8_t spsc;
+    volatile uint8_t spsc_receiver_waiting; // consumer đang chờ có bấy nhiêu phần tử (0: không chờ)
+    volatile uint8_t spsc_sender_waiting;   // producer đang chờ có bấy nhiêu chỗ trống (0: không chờ)
+    volatile uint32_t spsc_head;            // chỉ producer ghi
+    volatile uint32_t spsc_tail;            // chỉ consumer ghi
+    PCB_t *producer;
+    PCB_t *consumer;
+
 } os_msg_queue_t;
 
+/* Hàng đợi thường là đối tượng kernel (OS_KERNEL_OBJECT), task dùng qua syscall */
 void msg_queue_init(os_msg_queue_t *q); // Khởi tạo hàng đợi tin nhắn
+
+/* Một producer, một consumer cố định: send/receive chạy ngay ở phía gọi, chỉ vào
+   kernel khi phải chặn (notify_wait) hoặc đánh thức phía kia (notify_give).
+   Hai task đọc ghi q trực tiếp nên q phải nằm trong vùng chia sẻ (OS_SHARED) và cả
+   hai phải có OS_CAP_SHARED, nếu không trả OS_ERR_PARAM và q không được dùng:
+   task bị cô lập bằng MPU thì dùng hàng đợi thường. Dùng task notification của 2
+   task này: không dùng notify cho việc khác trong 2 task đó. Timeout tính cho cả
+   lời gọi, kể cả khi bị đánh thức thừa. */
+os_status_t msg_queue_init_spsc(os_msg_queue_t *q, PCB_t *producer, PCB_t *consumer);
 void msg_queue_send(os_msg_queue_t *q, int32_t data); // Gửi tin nhắn vào hàng đợi
 int32_t msg_queue_receive(os_msg_queue_t *q); // Nhận tin nhắn từ hàng đợi
 
+/* Dạng có timeout (tick) / không chờ: trả về OS_OK, OS_ERR_TIMEOUT hoặc OS_ERR_WOULD_BLOCK */
+os_status_t msg_queue_send_timeout(os_msg_queue_t *q, int32_t data, uint32_t timeout);
+os_status_t msg_queue_receive_timeout(os_msg_queue_t *q, int32_t *data, uint32_t timeout);
+os_status_t msg_queue_try_send(os_msg_queue_t *q, int32_t data);
+os_status_t msg_queue_try_receive(os_msg_queue_t *q, int32_t *data);
+
+/* --- GỬI / NHẬN THEO LÔ ---
+   Mỗi lượt chuyển hết những gì đang có chỗ / có dữ liệu dưới một lần khóa và
+   đánh thức phía kia một lần. Gọi lại tới khi chuyển được ít nhất min_count
+   phần tử hoặc hết timeout (tính cho cả lời gọi, không phải từng lần chờ). */
+typedef struct {
+    int32_t *data;      // mảng của người gọi
+    uint32_t count;     // vào: số phần tử của mảng; ra: số phần tử đã chuyển
+    uint32_t min_count; // chờ tới khi chuyển đủ bấy nhiêu (0: không chờ, > count: = count)
+} os_msg_batch_t;
+
+/* OS_OK nếu chuyển được >= min_count, ngược lại OS_ERR_TIMEOUT (hoặc
+   OS_ERR_WOULD_BLOCK khi timeout = OS_NO_WAIT); batch->count luôn là số đã chuyển */
+os_status_t msg_queue_send_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout);
+os_status_t msg_queue_receive_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout);
+
+/* --- HÀNG ĐỢI BUFFER (zero-copy) ---
+   Payload nằm trong block của một os_pool_t; hàng đợi chỉ chuyển descriptor
+   (con trỏ + số byte). Gửi đi thì người gửi mất quyền dùng buffer, người nhận
+   dùng xong phải buf_queue_release(). Task unprivileged chạm vào payload thì pool
+   phải đặt trong vùng chia sẻ (OS_POOL_STORAGE_SHARED) và cả hai phía cần OS_CAP_SHARED;
+   buf_queue_send từ task chỉ nhận block thuộc đúng pool của hàng đợi. */
+#define MAX_BUF_MESSAGE_COUNT 8
+
+typedef struct {
+    void *data;
+    uint32_t size;  // số byte hợp lệ trong buffer (<= buf_queue_capacity)
+} os_buf_msg_t;
+
+typedef struct {
+    os_buf_msg_t msgs[MAX_BUF_MESSAGE_COUNT];
+    int head;
+    int tail;
+    os_pool_t *pool; // nơi lấy / trả buffer
+
+    os_mutex_t mutex_lock;
+    os_sem_t sem_data;
+    os_sem_t sem_space;
+} os_buf_queue_t;
+
+void buf_queue_init(os_buf_queue_t *q, os_pool_t *pool);
+void *buf_queue_alloc(os_buf_queue_t *q);           // NULL nếu pool hết buffer, không chờ
+uint32_t buf_queue_capacity(os_buf_queue_t *q);     // số byte tối đa của 1 buffer
+void buf_queue_release(os_buf_queue_t *q, void *buf);
+
+/* size > capacity: OS_ERR_PARAM, buffer vẫn thuộc người gửi */
+os_status_t buf_queue_send(os_buf_queue_t *q, void *buf, uint32_t size, uint32_t timeout);
+os_status_t buf_queue_receive(os_buf_queue_t *q, void **buf, uint32_t *size, uint32_t timeout);
+
 #endif
\ No newline at end of file
@@ -5,19 +5,20 @@
 #include "sync.h" 
 #include "ipc.h"
 #include "mpu.h"
+#include "bench.h"
 #include <stdint.h>
 
 
-#define SYSTEM_CLOCK      80000000 // clock mcu 
+#define SYSTEM_CLOCK      OS_CPU_CLOCK_HZ // clock mcu 
 #define SYSTICK_RATE      8000000  // set systick reload để tạo ngắt mỗi 0.1s (10Hz)
 // nhịp tim của hệ điều hành, nó sẽ đếm từ  8 000 000 về 0
 
-os_msg_queue_t temp_queue; // Hàng đợi tin nhắn cho nhiệt độ
-os_mutex_t app_mutex; // chiếc khóa chung cho cả hệ thống
+os_msg_queue_t temp_queue OS_SHARED; // Hàng đợi nhiệt độ, SPSC: sensor và display đọc ghi trực tiếp
+os_mutex_t app_mutex OS_KERNEL_OBJECT(os_mutex_t); // chiếc khóa chung cho cả hệ thống
 
 // tạo deadlock giả
-os_mutex_t mutex_A;
-os_mutex_t mutex_B;
+os_mutex_t mutex_A OS_KERNEL_OBJECT(os_mutex_t);
+os_mutex_t mutex_B OS_KERNEL_OBJECT(os_mutex_t);
 // tạo deadlock giả
 
 void delay(volatile unsigned int count) {
@@ -31,30 +32,49 @@ void main(void) {
     uart_init();
     banker_init();
     mpu_init();
+    svc_init();
     process_init();
 
-    msg_queue_init(&temp_queue);
     mutex_init(&app_mutex);
     mutex_init(&mutex_A);
     mutex_init(&mutex_B);
-    int max_res_t1[] = {0, 0, 2}; 
-    int max_res_t2[] = {0, 0, 2};
     
     uart_print("\033[2J"); // Lệnh xóa màn hình terminal (nếu hỗ trợ)
     uart_print("MyOS IoT System Booting...\r\n");
     delay(5000000); // Chờ khởi động
 
+#ifdef OS_BENCH
+    bench_run_boot();
+    bench_create_tasks();
+#else
+    int max_res_t1[] = {0, 0, 2}; 
+    int max_res_t2[] = {0, 0, 2};
+
     /* Tạo các task với chức năng cụ thể */
-    process_create(task_sensor_update, 1, 4, NULL); 
-    process_create(task_display, 2, 2, NULL);       
+    process_create_args_t sensor_args = {
+        .entry = task_sensor_update, .pid = 1, .priority = 4, .stack_size = STACK_SIZE * 4, .caps = OS_CAP_SHARED,
+    };
+    process_create_args_t display_args = {
+        .entry = task_display, .pid = 2, .priority = 2, .stack_size = STACK_SIZE * 4, .caps = OS_CAP_SHARED,
+    };
+    process_create_args(&sensor_args);
+    process_create_args(&display_args);
+    // sensor (PID 1) -> display (PID 2): đánh thức bằng task notification, không qua semaphore
+    if (msg_queue_init_spsc(&temp_queue, &pcb_table[1], &pcb_table[2]) != OS_OK) {
+        uart_print("temp_queue: SPSC init failed\r\n");
+    }
     process_create(task_alarm, 3, 3, NULL);         
     process_create(task_logger, 4, 4, NULL);              
-    process_create(task_shell, 5, 1, NULL);
+    process_create_args_t shell_args = { // OS_CAP_REBOOT: lệnh 'reboot'
+        .entry = task_shell, .pid = 5, .priority = 1, .stack_size = STACK_SIZE * 4, .caps = OS_CAP_REBOOT,
+    };
+    process_create_args(&shell_args);
     process_create(task_deadlock_1, 6, 5, NULL);
     process_create(task_deadlock_2, 7, 5, NULL);
     process_create(task_banker1, 8, 4, max_res_t1);
     process_create(task_banker2, 9, 4, max_res_t2);
     //process_admit_jobs();
+#endif
 
     /* Khởi động nhịp tim hệ thống */
     systick_init(SYSTICK_RATE); // kích hoạt hệ thống 
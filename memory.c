@@ -1,112 +1,944 @@
 #include "memory.h"
+
+#ifndef OS_HOST_BENCH
 #include "mpu.h"
 #include "process.h"
+#else
+/* Bản build trên máy host (tools/heap_bench.c): một luồng, không syscall,
+   không vùng tới hạn, không vùng stack */
+#define OS_ENTER_CRITICAL()
+#define OS_EXIT_CRITICAL()
+#define os_is_privileged()         1
+#define os_syscall0(num)           0
+#define os_syscall1(num, a0)       ((void)0)
+#define os_syscall2(num, a0, a1)   0
+#define heap_owner()               0
+#endif
 
 static uint8_t heap_area[HEAP_SIZE] __attribute__((aligned(4096))); // aligned(8) đảm bảo mảng này bắt đầu ở địa chỉ chia hết cho 8
-static mem_block_t *free_list = NULL; // con trỏ đầu danh sách
+
+#ifndef OS_HOST_BENCH
+/* Chủ của block mới: task đang chạy nếu gọi từ thread mode hoặc qua SVC
+   (syscall của task), 0 nếu gọi từ ISR hay trước khi scheduler chạy */
+static inline uint32_t heap_owner(void)
+{
+    uint32_t ipsr;
+    __asm volatile ("mrs %0, ipsr" : "=r" (ipsr));
+    if ((ipsr == 0 || ipsr == 11) && current_pcb != NULL) { // 11 = SVCall
+        return current_pcb->pid + 1;
+    }
+    return 0;
+}
+
+#define HEAP_GENERAL_OFFSET OS_REGION_POOL_SIZE // heap_area = [vùng region MPU | heap chung]
+static void region_pool_init(void);
+#else
+#define HEAP_GENERAL_OFFSET 0
+#endif
+
+/* ============================================================
+   HEAP CHUNG: TLSF (Two-Level Segregated Fit)
+   - Mức 1 (fl): lũy thừa 2 của kích thước; mức 2 (sl): chia mỗi khoảng
+     [2^fl, 2^(fl+1)) thành TLSF_SL_COUNT phần bằng nhau.
+   - Mỗi (fl, sl) là một danh sách block free; 2 bitmap cho biết danh sách
+     nào khác rỗng -> tìm block bằng vài lệnh clz/ctz, malloc/free O(1).
+   - Block nào cũng biết block vật lý liền trước -> gộp được cả 2 phía khi free.
+   ============================================================ */
+#define TLSF_ALIGN_LOG2   3
+#define TLSF_ALIGN        (1U << TLSF_ALIGN_LOG2)         // 8 byte
+#define TLSF_SL_LOG2      4
+#define TLSF_SL_COUNT     (1U << TLSF_SL_LOG2)            // 16 danh sách / mức 1
+#define TLSF_FL_SHIFT     (TLSF_SL_LOG2 + TLSF_ALIGN_LOG2)
+#define TLSF_SMALL_BLOCK  (1U << TLSF_FL_SHIFT)           // < 128 byte: chia tuyến tính theo 8 byte
+#define TLSF_FL_MAX       16                              // block lớn nhất < 2^16 >= HEAP_SIZE
+#define TLSF_FL_COUNT     (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+#define BLOCK_FREE_BIT    1U                              // bit 0 của size: block đang free
+#define BLOCK_OWNER_SHIFT 24                              // bit 24-31 của size: PID + 1 của chủ (0 = kernel/ISR)
+#define BLOCK_SIZE_MASK   (((size_t)1 << BLOCK_OWNER_SHIFT) - TLSF_ALIGN)
+#define BLOCK_HDR_SIZE    offsetof(mem_block_t, next_free) // phần header luôn tồn tại
+#define BLOCK_MIN_SIZE    (sizeof(mem_block_t) - BLOCK_HDR_SIZE) // payload tối thiểu: đủ chỗ cho 2 con trỏ free list
+#define BLOCK_MAX_SIZE    ((size_t)1 << TLSF_FL_MAX)
+
+static uint32_t fl_bitmap;                                // bit fl = 1: có ít nhất 1 danh sách (fl, *) khác rỗng
+static uint32_t sl_bitmap[TLSF_FL_COUNT];
+static mem_block_t *free_blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+/* Thống kê: cập nhật ngay trong malloc/free, đọc không cần duyệt heap */
+static size_t heap_total_bytes;    // payload của heap rỗng
+static size_t heap_free_bytes;     // tổng payload các block đang nằm trong free list
+static size_t heap_min_free_bytes; // low-water mark
+static uint32_t heap_alloc_count;
+static uint32_t heap_free_count;
+static uint32_t heap_failed_allocs;
+static size_t heap_last_failed_size;
+static size_t heap_last_failed_free;    // free_bytes / block lớn nhất lúc lần cấp đó hỏng
+static size_t heap_last_failed_largest;
+
+static inline int tlsf_fls(uint32_t word) // bit cao nhất được set
+{
+    return 31 - __builtin_clz(word);
+}
+
+static inline int tlsf_ffs(uint32_t word) // bit thấp nhất được set
+{
+    return __builtin_ctz(word);
+}
+
+static inline size_t block_size(const mem_block_t *b)
+{
+    return b->size & BLOCK_SIZE_MASK;
+}
+
+static inline uint32_t block_owner(const mem_block_t *b) // PID + 1, 0 = kernel/ISR
+{
+    return (uint32_t)(b->size >> BLOCK_OWNER_SHIFT);
+}
+
+static inline int block_is_free(const mem_block_t *b)
+{
+    return (b->size & BLOCK_FREE_BIT) != 0;
+}
+
+static inline void *block_to_ptr(const mem_block_t *b)
+{
+    return (uint8_t *)b + BLOCK_HDR_SIZE;
+}
+
+static inline mem_block_t *block_from_ptr(const void *ptr)
+{
+    return (mem_block_t *)((uint8_t *)ptr - BLOCK_HDR_SIZE);
+}
+
+static inline mem_block_t *block_next(const mem_block_t *b)
+{
+    return (mem_block_t *)((uint8_t *)block_to_ptr(b) + block_size(b));
+}
+
+/* Kích thước -> (fl, sl) của danh sách chứa nó */
+static void mapping_insert(size_t size, int *fl, int *sl)
+{
+    if (size < TLSF_SMALL_BLOCK) {
+        *fl = 0;
+        *sl = (int)(size / (TLSF_SMALL_BLOCK / TLSF_SL_COUNT));
+    } else {
+        int f = tlsf_fls((uint32_t)size);
+        *sl = (int)(size >> (f - TLSF_SL_LOG2)) ^ (int)TLSF_SL_COUNT;
+        *fl = f - (TLSF_FL_SHIFT - 1);
+    }
+}
+
+/* Như mapping_insert nhưng làm tròn lên: mọi block trong danh sách tìm được đều đủ lớn */
+static void mapping_search(size_t size, int *fl, int *sl)
+{
+    if (size >= TLSF_SMALL_BLOCK) {
+        size += ((size_t)1 << (tlsf_fls((uint32_t)size) - TLSF_SL_LOG2)) - 1;
+    }
+    mapping_insert(size, fl, sl);
+}
+
+static void free_list_remove(mem_block_t *b, int fl, int sl)
+{
+    heap_free_bytes -= block_size(b);
+    if (b->prev_free) b->prev_free->next_free = b->next_free;
+    if (b->next_free) b->next_free->prev_free = b->prev_free;
+
+    if (free_blocks[fl][sl] == b) {
+        free_blocks[fl][sl] = b->next_free;
+        if (b->next_free == NULL) {
+            sl_bitmap[fl] &= ~(1UL << sl);
+            if (sl_bitmap[fl] == 0) {
+                fl_bitmap &= ~(1UL << fl);
+            }
+        }
+    }
+}
+
+static void free_list_insert(mem_block_t *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+
+    b->prev_free = NULL;
+    b->next_free = free_blocks[fl][sl];
+    if (b->next_free) b->next_free->prev_free = b;
+    free_blocks[fl][sl] = b;
+
+    fl_bitmap |= (1UL << fl);
+    sl_bitmap[fl] |= (1UL << sl);
+    heap_free_bytes += block_size(b);
+}
+
+static void block_remove(mem_block_t *b)
+{
+    int fl, sl;
+    mapping_insert(block_size(b), &fl, &sl);
+    free_list_remove(b, fl, sl);
+}
+
+/* Tìm danh sách khác rỗng đầu tiên có block >= size (không duyệt block nào) */
+static mem_block_t *search_suitable_block(size_t size)
+{
+    int fl, sl;
+    mapping_search(size, &fl, &sl);
+    if (fl >= (int)TLSF_FL_COUNT) {
+        return NULL;
+    }
+
+    uint32_t sl_map = sl_bitmap[fl] & (~0UL << sl);
+    if (sl_map == 0) {
+        uint32_t fl_map = (fl + 1 < 32) ? (fl_bitmap & (~0UL << (fl + 1))) : 0;
+        if (fl_map == 0) {
+            return NULL; // Hết bộ nhớ (hoặc không còn block đủ lớn)
+        }
+        fl = tlsf_ffs(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+    sl = tlsf_ffs(sl_map);
+
+    mem_block_t *b = free_blocks[fl][sl];
+    free_list_remove(b, fl, sl);
+    return b;
+}
+
+/* Block free lớn nhất: nằm trong danh sách (fl, sl) cao nhất khác rỗng, nhưng danh
+   sách đó không sắp theo kích thước nên phải duyệt hết nó. Chỉ dùng khi cấp hỏng. */
+static size_t largest_free_block(void)
+{
+    if (fl_bitmap == 0) {
+        return 0;
+    }
+    int fl = tlsf_fls(fl_bitmap);
+    int sl = tlsf_fls(sl_bitmap[fl]);
+    size_t largest = 0;
+    for (mem_block_t *b = free_blocks[fl][sl]; b != NULL; b = b->next_free) {
+        if (block_size(b) > largest) largest = block_size(b);
+    }
+    return largest;
+}
+
+/* Ghi lại lần cấp hỏng kèm trạng thái heap lúc đó, để 'heap' phân biệt hết bộ nhớ
+   với phân mảnh theo đúng thời điểm hỏng. Gọi khi đã tắt ngắt. */
+static void heap_record_failure(size_t size)
+{
+    heap_failed_allocs++;
+    heap_last_failed_size = size;
+    heap_last_failed_free = heap_free_bytes;
+    heap_last_failed_largest = largest_free_block();
+}
+
+/* Tách phần đuôi của block (đã rời free list) thành block free mới nếu đủ lớn */
+static void block_trim_tail(mem_block_t *b, size_t size)
+{
+    if (block_size(b) < size + sizeof(mem_block_t)) {
+        return; // phần dư không đủ làm 1 block: để nguyên trong block này
+    }
+
+    mem_block_t *rest = (mem_block_t *)((uint8_t *)block_to_ptr(b) + size);
+    rest->size = (block_size(b) - size - BLOCK_HDR_SIZE) | BLOCK_FREE_BIT;
+    rest->prev_phys = b;
+    block_next(rest)->prev_phys = rest;
+    b->size = size | (b->size & ~BLOCK_SIZE_MASK); // giữ cờ free và chủ
+    free_list_insert(rest);
+}
+
+/* Gộp block free b với block vật lý liền sau nếu cũng free; trả về block kết quả */
+static mem_block_t *block_merge_next(mem_block_t *b)
+{
+    mem_block_t *next = block_next(b);
+    if (block_is_free(next)) {
+        block_remove(next);
+        b->size += BLOCK_HDR_SIZE + block_size(next);
+        block_next(b)->prev_phys = b;
+    }
+    return b;
+}
+
+static mem_block_t *block_merge_prev(mem_block_t *b)
+{
+    mem_block_t *prev = b->prev_phys;
+    if (prev != NULL && block_is_free(prev)) {
+        block_remove(prev);
+        prev->size += BLOCK_HDR_SIZE + block_size(b);
+        block_next(prev)->prev_phys = prev;
+        return prev;
+    }
+    return b;
+}
+
+static size_t adjust_request_size(size_t size)
+{
+    size = (size + TLSF_ALIGN - 1) & ~(size_t)(TLSF_ALIGN - 1);
+    return (size < BLOCK_MIN_SIZE) ? BLOCK_MIN_SIZE : size;
+}
 
 void os_mem_init(void) {
-    free_list = (mem_block_t *)heap_area;
-    free_list->next = NULL;
-    free_list->size = HEAP_SIZE - sizeof(mem_block_t);
-    free_list->is_free = 1;
+    uint8_t *start = heap_area + HEAP_GENERAL_OFFSET;
+    size_t total = HEAP_SIZE - HEAP_GENERAL_OFFSET;
+
+    fl_bitmap = 0;
+    for (unsigned i = 0; i < TLSF_FL_COUNT; i++) {
+        sl_bitmap[i] = 0;
+        for (unsigned j = 0; j < TLSF_SL_COUNT; j++) {
+            free_blocks[i][j] = NULL;
+        }
+    }
+
+    /* Một block free lớn + block "đuôi" size 0 luôn used làm lính canh,
+       để block_next() của block cuối không bao giờ đi ra ngoài heap */
+    mem_block_t *b = (mem_block_t *)start;
+    b->prev_phys = NULL;
+    b->size = (total - BLOCK_HDR_SIZE - sizeof(mem_block_t)) | BLOCK_FREE_BIT;
+
+    mem_block_t *sentinel = block_next(b);
+    sentinel->prev_phys = b;
+    sentinel->size = 0;
+
+    heap_free_bytes = 0;
+    free_list_insert(b);
+    heap_total_bytes = heap_free_bytes;
+    heap_min_free_bytes = heap_free_bytes;
+    heap_alloc_count = 0;
+    heap_free_count = 0;
+    heap_failed_allocs = 0;
+    heap_last_failed_size = 0;
+    heap_last_failed_free = 0;
+    heap_last_failed_largest = 0;
+
+#ifndef OS_HOST_BENCH
+    region_pool_init();
+#endif
 }
 
 void* os_malloc(size_t size) 
 {
-    return os_malloc_aligned(size, 8);
+    return os_malloc_aligned(size, TLSF_ALIGN);
 }
 
+/* Căn lề lớn hơn 8: xin dư (alignment + 1 header tối thiểu), sau đó tách phần đệm
+   phía trước thành block free thật (không còn block "dummy" không bao giờ trả lại) */
 void* os_malloc_aligned(size_t size, size_t alignment) {
-    if (alignment < 8) alignment = 8;
+    if (!os_is_privileged()) {
+        return (void *)os_syscall2(SYS_MALLOC, size, alignment);
+    }
+    if (alignment < TLSF_ALIGN) alignment = TLSF_ALIGN;
     if ((alignment & (alignment - 1)) != 0) {
         return NULL;  /* alignment phải là power of 2 */
     }
+    if (size == 0) {
+        return NULL;
+    }
+    if (size >= BLOCK_MAX_SIZE) {
+        OS_ENTER_CRITICAL();
+        heap_record_failure(size);
+        OS_EXIT_CRITICAL();
+        return NULL;
+    }
+    uint32_t owner = heap_owner(); // đọc trước khi vào vùng tới hạn
 
-    void *ptr = NULL;
-    size = (size + 7) & ~0x07;  /* Round up to 8 bytes */
+    size = adjust_request_size(size);
+    size_t gap_min = sizeof(mem_block_t);
+    size_t search = (alignment > TLSF_ALIGN) ? size + alignment + gap_min : size;
 
     OS_ENTER_CRITICAL();
-    
-    mem_block_t *current = free_list;
-    while (current) {
-        if (current->is_free && current->size >= size) {
-            /* Tính địa chỉ data sau header */
-            uintptr_t data_addr = (uintptr_t)current + sizeof(mem_block_t);
-            
-            /* Tính offset cần thiết để align */
-            uintptr_t aligned_addr = (data_addr + alignment - 1) & ~(alignment - 1);
-            size_t padding = aligned_addr - data_addr;
-            
-            /* Kiểm tra có đủ chỗ cho padding + size không */
-            if (current->size >= size + padding) {
-                /* Nếu có padding, tạo dummy block */
-                if (padding >= sizeof(mem_block_t) + 8) {
-                    mem_block_t *padding_block = current;
-                    mem_block_t *aligned_block = (mem_block_t*)(aligned_addr - sizeof(mem_block_t));
-                    
-                    padding_block->size = padding - sizeof(mem_block_t);
-                    padding_block->is_free = 0;  /* Đánh dấu used để không merge */
-                    padding_block->next = aligned_block;
-                    
-                    aligned_block->size = current->size - padding;
-                    aligned_block->is_free = 1;
-                    aligned_block->next = current->next;
-                    
-                    current = aligned_block;
-                    data_addr = aligned_addr;
-                } else if (padding > 0) {
-                    /* Padding quá nhỏ, tìm block khác */
-                    current = current->next;
-                    continue;
-                }
-                
-                /* Split block nếu còn dư */
-                if (current->size > size + sizeof(mem_block_t) + 8) {
-                    mem_block_t *new_block = (mem_block_t*)((uint8_t*)current + sizeof(mem_block_t) + size);
-                    new_block->size = current->size - size - sizeof(mem_block_t);
-                    new_block->is_free = 1;
-                    new_block->next = current->next;
-                    current->size = size;
-                    current->next = new_block;
-                }
-                
-                current->is_free = 0;
-                ptr = (void*)data_addr;
-                break;
-            }
+
+    mem_block_t *b = search_suitable_block(search);
+    if (b == NULL) {
+        heap_record_failure(search);
+        OS_EXIT_CRITICAL();
+        return NULL;
+    }
+
+    if (alignment > TLSF_ALIGN) {
+        uintptr_t ptr = (uintptr_t)block_to_ptr(b);
+        uintptr_t aligned = (ptr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        if (aligned != ptr && aligned - ptr < gap_min) {
+            aligned += alignment; // khoảng đệm phải đủ chứa 1 block free
+        }
+
+        size_t gap = aligned - ptr;
+        if (gap != 0) {
+            /* Phần đệm phía trước giữ header cũ, block cấp phát bắt đầu ở aligned */
+            mem_block_t *lead = b;
+            b = block_from_ptr((void *)aligned);
+            b->size = block_size(lead) - gap;
+            b->prev_phys = lead;
+            block_next(b)->prev_phys = b;
+            lead->size = (gap - BLOCK_HDR_SIZE) | BLOCK_FREE_BIT;
+            // Block trước lead luôn đang dùng (free thì đã được gộp), không cần gộp lại
+            free_list_insert(lead);
         }
-        current = current->next;
     }
-    
+
+    b->size &= ~(size_t)BLOCK_FREE_BIT;
+    block_trim_tail(b, size);
+    b->size |= (size_t)owner << BLOCK_OWNER_SHIFT;
+
+    heap_alloc_count++;
+    if (heap_free_bytes < heap_min_free_bytes) {
+        heap_min_free_bytes = heap_free_bytes;
+    }
+
     OS_EXIT_CRITICAL();
-    return ptr;
+    return block_to_ptr(b);
 }
 
 void os_free(void *ptr) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_FREE, ptr);
+        return;
+    }
     if (ptr == NULL) return;
 
     OS_ENTER_CRITICAL();
 
-    mem_block_t *block = (mem_block_t*)((uint8_t*)ptr - sizeof(mem_block_t));
-    block->is_free = 1;
+    mem_block_t *b = block_from_ptr(ptr);
+    if (block_is_free(b)) {
+        OS_EXIT_CRITICAL(); // free 2 lần: bỏ qua
+        return;
+    }
 
-    mem_block_t *current = free_list;
-    while (current && current->next != block) 
-    {
-        current = current->next;
+    b->size = block_size(b) | BLOCK_FREE_BIT; // bỏ thẻ chủ
+    heap_free_count++;
+    b = block_merge_prev(b);
+    b = block_merge_next(b);
+    free_list_insert(b);
+    
+    OS_EXIT_CRITICAL();
+}
+
+/* SYS_FREE từ task: ptr phải đúng là đầu một block đang dùng do task đó cấp.
+   Header nằm ngoài tầm ghi của task nhưng ptr thì do task chọn, nên kiểm tra cả
+   2 liên kết vật lý để không nhận một địa chỉ rơi vào giữa block. Gọi khi đã tắt ngắt. */
+int os_heap_block_owned(const void *ptr, uint32_t owner)
+{
+    uint8_t *start = heap_area + HEAP_GENERAL_OFFSET;
+    uint8_t *end = heap_area + HEAP_SIZE;
+    uint8_t *p = (uint8_t *)ptr;
+
+    if (p < start + BLOCK_HDR_SIZE || p >= end || ((uintptr_t)p & (TLSF_ALIGN - 1)) != 0) {
+        return 0;
     }
-    if (block->next && block->next->is_free) 
-    {
-        block->size += sizeof(mem_block_t) + block->next->size;
-        block->next = block->next->next;
+    mem_block_t *b = block_from_ptr(ptr);
+    if (block_is_free(b) || block_size(b) == 0 || block_owner(b) != owner ||
+        block_size(b) > (size_t)(end - p - sizeof(mem_block_t))) {
+        return 0;
     }
-    
+    if (block_next(b)->prev_phys != b) {
+        return 0;
+    }
+    mem_block_t *prev = b->prev_phys;
+    if (prev == NULL) {
+        return (uint8_t *)b == start;
+    }
+    return (uint8_t *)prev >= start && (uint8_t *)prev < (uint8_t *)b && block_next(prev) == b;
+}
+
+/* ============================================================
+   THỐNG KÊ HEAP CHUNG
+   ============================================================ */
+size_t os_get_free_heap_size(void)
+{
+    if (!os_is_privileged()) {
+        return os_syscall0(SYS_HEAP_FREE);
+    }
+    return heap_free_bytes;
+}
+
+/* Số đếm lấy từ biến cập nhật sẵn; block lớn nhất và số block phải duyệt heap
+   (O(số block), chỉ dùng cho chẩn đoán) */
+void os_heap_get_stats(os_heap_stats_t *stats)
+{
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_HEAP_STATS, stats);
+        return;
+    }
+
+    size_t largest = 0;
+    uint32_t used_blocks = 0;
+    uint32_t free_blocks_count = 0;
+
+    OS_ENTER_CRITICAL();
+    for (mem_block_t *b = (mem_block_t *)(heap_area + HEAP_GENERAL_OFFSET); block_size(b) != 0; b = block_next(b)) {
+        if (block_is_free(b)) {
+            free_blocks_count++;
+            if (block_size(b) > largest) largest = block_size(b);
+        } else {
+            used_blocks++;
+        }
+    }
+    stats->total_bytes = heap_total_bytes;
+    stats->free_bytes = heap_free_bytes;
+    stats->min_free_bytes = heap_min_free_bytes;
+    stats->alloc_count = heap_alloc_count;
+    stats->free_count = heap_free_count;
+    stats->failed_allocs = heap_failed_allocs;
+    stats->last_failed_size = heap_last_failed_size;
+    stats->last_failed_free = heap_last_failed_free;
+    stats->last_failed_largest = heap_last_failed_largest;
     OS_EXIT_CRITICAL();
+
+    stats->largest_free = largest;
+    stats->used_blocks = used_blocks;
+    stats->free_blocks = free_blocks_count;
 }
 
+#ifdef OS_HOST_BENCH
+/* Chỉ cho tools/heap_bench.c: duyệt mọi block theo thứ tự vật lý */
+void os_heap_host_walk(void (*visit)(void *ptr, size_t size, int is_free))
+{
+    mem_block_t *b = (mem_block_t *)(heap_area + HEAP_GENERAL_OFFSET);
+    while (block_size(b) != 0) {
+        visit(block_to_ptr(b), block_size(b), block_is_free(b));
+        b = block_next(b);
+    }
+}
+#else
 uint32_t mpu_calc_alignment(size_t size) 
 {
     uint32_t size_bits = mpu_calc_region_size(size);
     return 1U << (size_bits + 1);
-}
\ No newline at end of file
+}
+
+/* ============================================================
+   VÙNG REGION MPU (stack, heap riêng của task): buddy allocator
+   - Block bậc k dài OS_REGION_MIN << k byte và luôn căn theo chính kích thước
+     của nó -> tự là một region MPU hợp lệ, không header, không padding.
+   - Cấp: tách đôi block nhỏ nhất đủ lớn, rồi trả lại các buddy ở đuôi mà vùng
+     không dùng tới (MPU tắt phần đuôi đó bằng SRD). Tối đa REGION_MAX_ORDER bước.
+   - Trả: mỗi mảnh gộp với buddy khi buddy cũng free cùng bậc, O(log n).
+   ============================================================ */
+#define REGION_MAX_ORDER  4                               // 256 << 4 = 4KB
+#define REGION_UNITS      (OS_REGION_POOL_SIZE / OS_REGION_MIN)
+#define REGION_TOP_UNITS  (1U << REGION_MAX_ORDER)        // số đơn vị của 1 block bậc cao nhất
+#define REGION_HEAD_FREE  0x80                            // region_head[u]: block free bắt đầu tại u, bậc ở 4 bit thấp
+#define REGION_HEAD_USED  0x40                            // đơn vị đầu của một vùng đang cấp
+
+_Static_assert((OS_REGION_MIN << REGION_MAX_ORDER) == OS_REGION_MAX, "OS_REGION_MAX must be OS_REGION_MIN << REGION_MAX_ORDER");
+_Static_assert(OS_REGION_POOL_SIZE % OS_REGION_MAX == 0, "region pool must hold whole top-order blocks");
+
+typedef struct region_free {
+    struct region_free *next;
+    struct region_free *prev;
+} region_free_t;
+
+static region_free_t *region_free_list[REGION_MAX_ORDER + 1]; // nằm ngay trong block free
+static uint8_t region_head[REGION_UNITS];
+
+static inline uint32_t region_unit(const void *addr)
+{
+    return ((uint32_t)addr - (uint32_t)heap_area) / OS_REGION_MIN;
+}
+
+static inline region_free_t *region_addr(uint32_t unit)
+{
+    return (region_free_t *)(heap_area + unit * OS_REGION_MIN);
+}
+
+static void region_push(uint32_t unit, uint32_t order)
+{
+    region_free_t *b = region_addr(unit);
+    b->prev = NULL;
+    b->next = region_free_list[order];
+    if (b->next) b->next->prev = b;
+    region_free_list[order] = b;
+    region_head[unit] = REGION_HEAD_FREE | order;
+}
+
+static void region_unlink(uint32_t unit, uint32_t order)
+{
+    region_free_t *b = region_addr(unit);
+    if (b->prev) {
+        b->prev->next = b->next;
+    } else {
+        region_free_list[order] = b->next;
+    }
+    if (b->next) b->next->prev = b->prev;
+    region_head[unit] = 0;
+}
+
+/* Trả 1 block bậc order, gộp lên chừng nào buddy cũng free cùng bậc */
+static void region_release(uint32_t unit, uint32_t order)
+{
+    region_head[unit] = 0;
+    while (order < REGION_MAX_ORDER) {
+        uint32_t buddy = unit ^ (1U << order);
+        if (region_head[buddy] != (REGION_HEAD_FREE | order)) {
+            break;
+        }
+        region_unlink(buddy, order);
+        unit &= buddy; // 2 buddy chỉ khác nhau bit order: lấy block thấp hơn
+        order++;
+    }
+    region_push(unit, order);
+}
+
+/* Trả khoảng [unit, unit + count) dưới dạng các block căn tự nhiên lớn nhất có thể */
+static void region_release_range(uint32_t unit, uint32_t count)
+{
+    while (count > 0) {
+        uint32_t order = (unit != 0) ? (uint32_t)__builtin_ctz(unit) : REGION_MAX_ORDER;
+        uint32_t fit = 31 - __builtin_clz(count);
+        if (order > fit) order = fit;
+        if (order > REGION_MAX_ORDER) order = REGION_MAX_ORDER;
+
+        region_release(unit, order);
+        unit += 1U << order;
+        count -= 1U << order;
+    }
+}
+
+static void region_pool_init(void)
+{
+    for (uint32_t i = 0; i <= REGION_MAX_ORDER; i++) {
+        region_free_list[i] = NULL;
+    }
+    for (uint32_t u = 0; u < REGION_UNITS; u++) {
+        region_head[u] = 0;
+    }
+    for (uint32_t u = 0; u < REGION_UNITS; u += REGION_TOP_UNITS) {
+        region_push(u, REGION_MAX_ORDER);
+    }
+}
+
+/* Làm tròn để vùng luôn mã hóa được bằng 1 region + SRD: bội OS_REGION_MIN
+   và bội subregion (1/8) của region lũy thừa 2 bao nó */
+size_t os_region_round(size_t size)
+{
+    if (size <= OS_REGION_MIN) {
+        return OS_REGION_MIN;
+    }
+    size_t region = (size_t)1 << (32 - __builtin_clz((uint32_t)size - 1));
+    size_t sub = region / 8;
+    if (sub < OS_REGION_MIN) sub = OS_REGION_MIN;
+    return (size + sub - 1) & ~(sub - 1);
+}
+
+void* os_region_alloc(size_t size)
+{
+    if (!os_is_privileged() || size == 0 || size > OS_REGION_MAX || size != os_region_round(size)) {
+        return NULL; // chỉ kernel cấp, size phải đã qua os_region_round()
+    }
+
+    uint32_t count = size / OS_REGION_MIN;
+    uint32_t want = (count > 1) ? 32 - __builtin_clz(count - 1) : 0; // log2 làm tròn lên
+
+    OS_ENTER_CRITICAL();
+
+    uint32_t order = want;
+    while (order <= REGION_MAX_ORDER && region_free_list[order] == NULL) {
+        order++;
+    }
+    if (order > REGION_MAX_ORDER) {
+        OS_EXIT_CRITICAL();
+        return NULL;
+    }
+
+    uint32_t unit = region_unit(region_free_list[order]);
+    region_unlink(unit, order);
+    while (order > want) { // tách đôi: nửa trên trở lại free list
+        order--;
+        region_push(unit + (1U << order), order);
+    }
+
+    region_head[unit] = REGION_HEAD_USED;
+    if (count < (1U << want)) {
+        region_release_range(unit + count, (1U << want) - count); // đuôi không dùng
+    }
+
+    OS_EXIT_CRITICAL();
+    return region_addr(unit);
+}
+
+void os_region_free(void *base, size_t size)
+{
+    if (base == NULL) return;
+
+    uint32_t unit = region_unit(base);
+
+    OS_ENTER_CRITICAL();
+    if (unit < REGION_UNITS && region_head[unit] == REGION_HEAD_USED) { // không phải vùng đang cấp: bỏ qua
+        region_release_range(unit, size / OS_REGION_MIN);
+    }
+    OS_EXIT_CRITICAL();
+}
+
+/* ============================================================
+   HEAP RIÊNG CỦA TASK (arena trong MPU region 2)
+   - Khối điều khiển (os_arena_t) nằm trong PCB, block free xâu theo thứ tự
+     địa chỉ và gộp với 2 block kề khi free. Arena chỉ vài KB nên first-fit là
+     đủ, thời gian bị chặn bởi kích thước arena.
+   - Header block và liên kết free list nằm trong arena, task ghi đè được:
+     kernel chỉ đọc/ghi qua một block sau khi arena_block_ok(), và free list
+     phải tăng dần không chồng lấn nên vòng duyệt luôn dừng. Arena bị ghi hỏng
+     thì chỉ chính task đó cấp/trả không được, kernel không ghi ra ngoài arena.
+   - Chỉ task chủ dùng arena của nó: không cần che ngắt hay khóa. Fast path
+     syscall chạy ở mức SVCall nên PendSV không chen vào giữa được, và task
+     đang nằm trong syscall nên không sửa header được giữa lúc kiểm tra và dùng.
+   ============================================================ */
+typedef struct arena_block {
+    uint32_t size;              // byte cả block (kể cả header), bội 8
+    struct arena_block *next;   // block free kế tiếp (chỉ có nghĩa khi free)
+} arena_block_t;
+
+#define ARENA_HDR_SIZE   sizeof(arena_block_t)
+#define ARENA_MIN_BLOCK  (ARENA_HDR_SIZE + 8)
+
+void os_arena_init(os_arena_t *arena, void *base, size_t size)
+{
+    arena_block_t *b = (arena_block_t *)base;
+
+    b->size = size;
+    b->next = NULL;
+    arena->free_list = b;
+    arena->used = 0;
+    arena->max_used = 0;
+    arena->failed = 0;
+}
+
+/* Task đang gọi nếu nó có heap riêng; NULL nếu gọi từ ISR hoặc task không có heap riêng */
+static PCB_t *arena_owner(void)
+{
+    uint32_t owner = heap_owner();
+    if (owner == 0) {
+        return NULL;
+    }
+    PCB_t *p = &pcb_table[owner - 1];
+    return (p->heap_size > 0) ? p : NULL;
+}
+
+/* Block nằm gọn trong arena, căn 8, kích thước hợp lệ; lower: block phải bắt đầu
+   từ đây trở đi (sau block đứng trước nó trong free list) */
+static int arena_block_ok(const PCB_t *p, const arena_block_t *b, uint32_t lower)
+{
+    uint32_t a = (uint32_t)b;
+    uint32_t end = p->heap_base + p->heap_size;
+    return a >= lower && a < end && (a & 7) == 0 &&
+           b->size >= ARENA_MIN_BLOCK && (b->size & 7) == 0 && b->size <= end - a;
+}
+
+void* os_task_malloc(size_t size)
+{
+    if (!os_is_privileged()) {
+        return (void *)os_syscall1(SYS_TASK_MALLOC, size);
+    }
+
+    PCB_t *p = arena_owner();
+    if (p == NULL || size == 0 || size > p->heap_size) {
+        return NULL;
+    }
+    os_arena_t *arena = &p->arena;
+
+    uint32_t need = ((size + 7) & ~7U) + ARENA_HDR_SIZE;
+    uint32_t lower = p->heap_base;
+    arena_block_t **link = &arena->free_list;
+    for (arena_block_t *b = *link; b != NULL; link = &b->next, b = b->next) {
+        if (!arena_block_ok(p, b, lower)) {
+            break; // free list bị task ghi hỏng
+        }
+        lower = (uint32_t)b + b->size;
+        if (b->size < need) {
+            continue;
+        }
+        if (b->size - need >= ARENA_MIN_BLOCK) {
+            arena_block_t *rest = (arena_block_t *)((uint8_t *)b + need);
+            rest->size = b->size - need;
+            rest->next = b->next;
+            b->size = need;
+            *link = rest;
+        } else {
+            *link = b->next; // phần dư quá nhỏ: cấp luôn cả block
+        }
+
+        arena->used += b->size;
+        if (arena->used > arena->max_used) {
+            arena->max_used = arena->used;
+        }
+        return (uint8_t *)b + ARENA_HDR_SIZE;
+    }
+
+    arena->failed++;
+    return NULL;
+}
+
+void os_task_free(void *ptr)
+{
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_TASK_FREE, ptr);
+        return;
+    }
+
+    PCB_t *p = arena_owner();
+    if (p == NULL || ptr == NULL) {
+        return;
+    }
+    os_arena_t *arena = &p->arena;
+
+    arena_block_t *b = (arena_block_t *)((uint8_t *)ptr - ARENA_HDR_SIZE);
+    if (!arena_block_ok(p, b, p->heap_base) || b->size > arena->used) {
+        return; // không thuộc arena của task này, hoặc header đã bị ghi hỏng
+    }
+
+    arena_block_t *prev = NULL;
+    arena_block_t *next = arena->free_list;
+    uint32_t lower = p->heap_base;
+    while (next != NULL && next < b) {
+        if (!arena_block_ok(p, next, lower)) {
+            return;
+        }
+        lower = (uint32_t)next + next->size;
+        prev = next;
+        next = next->next;
+    }
+    if (next != NULL && !arena_block_ok(p, next, lower)) {
+        return;
+    }
+    // free 2 lần, hoặc b chồng lên một block free
+    if ((uint32_t)b < lower || (next != NULL && (uint8_t *)b + b->size > (uint8_t *)next)) {
+        return;
+    }
+
+    arena->used -= b->size;
+
+    /* Gộp với block sau, rồi với block trước nếu kề nhau */
+    if (next != NULL && (uint8_t *)b + b->size == (uint8_t *)next) {
+        b->size += next->size;
+        b->next = next->next;
+    } else {
+        b->next = next;
+    }
+    if (prev != NULL && (uint8_t *)prev + prev->size == (uint8_t *)b) {
+        prev->size += b->size;
+        prev->next = b->next;
+    } else if (prev != NULL) {
+        prev->next = b;
+    } else {
+        arena->free_list = b;
+    }
+}
+
+/* Tổng byte còn trống và block free lớn nhất của vùng region MPU */
+void os_region_get_stats(size_t *free_bytes, size_t *largest_free)
+{
+    size_t total = 0;
+    size_t largest = 0;
+
+    OS_ENTER_CRITICAL();
+    for (uint32_t order = 0; order <= REGION_MAX_ORDER; order++) {
+        for (region_free_t *b = region_free_list[order]; b != NULL; b = b->next) {
+            total += (size_t)OS_REGION_MIN << order;
+            largest = (size_t)OS_REGION_MIN << order;
+        }
+    }
+    OS_EXIT_CRITICAL();
+
+    *free_bytes = total;
+    *largest_free = largest;
+}
+
+/* Lệnh shell "heap": thống kê heap chung, vùng region và lượng dùng theo task.
+   "fragmented": lần cấp hỏng gần nhất có đủ byte trống nhưng không có block đủ lớn */
+void os_heap_print(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_HEAP_PRINT);
+        return;
+    }
+
+    os_heap_stats_t st;
+    size_t region_free, region_largest;
+    static uint32_t owner_bytes[MAX_PROCESSES + 1];  // [0] = kernel/ISR, [pid + 1] = task
+    static uint32_t owner_blocks[MAX_PROCESSES + 1];
+
+    os_heap_get_stats(&st);
+    os_region_get_stats(&region_free, &region_largest);
+
+    for (int i = 0; i <= MAX_PROCESSES; i++) {
+        owner_bytes[i] = 0;
+        owner_blocks[i] = 0;
+    }
+    OS_ENTER_CRITICAL();
+    for (mem_block_t *b = (mem_block_t *)(heap_area + HEAP_GENERAL_OFFSET); block_size(b) != 0; b = block_next(b)) {
+        uint32_t owner = block_owner(b);
+        if (!block_is_free(b) && owner <= MAX_PROCESSES) {
+            owner_bytes[owner] += block_size(b);
+            owner_blocks[owner]++;
+        }
+    }
+    OS_EXIT_CRITICAL();
+
+    uart_print("Heap: ");
+    uart_print_dec(st.free_bytes);
+    uart_putc('/');
+    uart_print_dec(st.total_bytes);
+    uart_print(" free, min ");
+    uart_print_dec(st.min_free_bytes);
+    uart_print(", largest ");
+    uart_print_dec(st.largest_free);
+    uart_print("\r\n  blocks ");
+    uart_print_dec(st.used_blocks);
+    uart_print(" used / ");
+    uart_print_dec(st.free_blocks);
+    uart_print(" free, allocs ");
+    uart_print_dec(st.alloc_count);
+    uart_print(", frees ");
+    uart_print_dec(st.free_count);
+    uart_print(", failed ");
+    uart_print_dec(st.failed_allocs);
+    if (st.failed_allocs > 0) {
+        uart_print(" (last ");
+        uart_print_dec(st.last_failed_size);
+        uart_print(" B with ");
+        uart_print_dec(st.last_failed_free);
+        uart_print(" free, largest ");
+        uart_print_dec(st.last_failed_largest);
+        uart_print(st.last_failed_free >= st.last_failed_size ? ": fragmented)" : ": exhausted)");
+    }
+    uart_print("\r\nRegions: ");
+    uart_print_dec(region_free);
+    uart_putc('/');
+    uart_print_dec(OS_REGION_POOL_SIZE);
+    uart_print(" free, largest ");
+    uart_print_dec(region_largest);
+    uart_print("\r\n");
+
+    uart_print("PID HEAP  BLOCKS REGION ARENA\r\n");
+    if (owner_blocks[0] > 0) {
+        uart_print("K   ");
+        uart_print_dec(owner_bytes[0]);
+        uart_print("  ");
+        uart_print_dec(owner_blocks[0]);
+        uart_print("\r\n");
+    }
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        PCB_t *p = &pcb_table[i];
+        if (p->entry == NULL && owner_blocks[i + 1] == 0) continue;
+
+        // Stack nằm trong vùng region (không phải stack tĩnh .task_stacks) + heap riêng
+        uint32_t region = p->heap_size;
+        if (p->stack_base >= (uint32_t)heap_area && p->stack_base < (uint32_t)heap_area + OS_REGION_POOL_SIZE) {
+            region += p->stack_size;
+        }
+
+        uart_print_dec(i);
+        uart_print("   ");
+        uart_print_dec(owner_bytes[i + 1]);
+        uart_print("  ");
+        uart_print_dec(owner_blocks[i + 1]);
+        uart_print("  ");
+        uart_print_dec(region);
+        if (p->heap_size > 0) {
+            os_arena_t *arena = &p->arena;
+            uart_print("  ");
+            uart_print_dec(arena->used);
+            uart_putc('/');
+            uart_print_dec(p->heap_size);
+            if (arena->failed > 0) {
+                uart_print(" fail ");
+                uart_print_dec(arena->failed);
+            }
+        }
+        uart_print("\r\n");
+    }
+}
+#endif /* OS_HOST_BENCH */
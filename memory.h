@@ -6,17 +6,69 @@
 
 #define HEAP_SIZE (32 * 1024)
 
+/* Vùng region MPU: OS_REGION_POOL_SIZE byte đầu của heap_area, do buddy allocator
+   quản lý (memory.c). Mỗi vùng cấp ra nằm gọn trong một region MPU căn tự nhiên,
+   phần region thừa ở đuôi bị tắt bằng SRD. Dùng cho stack và heap riêng của task. */
+#define OS_REGION_POOL_SIZE (16 * 1024)
+#define OS_REGION_MIN 256                 // block nhỏ nhất: region nhỏ nhất còn có SRD
+#define OS_REGION_MAX (4 * 1024)          // block lớn nhất (heap_area chỉ căn 4KB)
+
+/* Header block của heap TLSF (memory.c). Block đang dùng chỉ tốn prev_phys + size,
+   next_free/prev_free nằm đè lên payload và chỉ có nghĩa khi block free. */
 typedef struct mem_block {
-    struct mem_block * next;
-    size_t size;
-    uint8_t is_free;
+    struct mem_block *prev_phys; // Block liền trước trong bộ nhớ (NULL nếu là block đầu)
+    size_t size;                 // Kích thước payload (bội 8), bit 0 = free, bit 24-31 = PID + 1 của chủ
+    struct mem_block *next_free;
+    struct mem_block *prev_free;
 } mem_block_t;
 
 void os_mem_init(void); // create heap
 void* os_malloc(size_t size);
 void* os_malloc_aligned(size_t size, size_t alignment);
 void os_free(void *ptr);
+int os_heap_block_owned(const void *ptr, uint32_t owner); // owner = PID + 1; svc.c kiểm tra SYS_FREE
 uint32_t mpu_calc_alignment(size_t size);
+
+size_t os_region_round(size_t size);          // làm tròn lên kích thước mà 1 region MPU + SRD phủ đúng
+void* os_region_alloc(size_t size);           // size phải đã qua os_region_round(); chỉ kernel gọi
+void os_region_free(void *base, size_t size); // size như lúc cấp
+
+/* Heap riêng của task (process_create_args_t.heap_size): nằm trong MPU region 2
+   nên chỉ task đó truy cập được. Chỉ task chủ gọi (không gọi từ ISR), vì vậy
+   không cần vùng tới hạn. Trả về NULL nếu task không có heap riêng hoặc hết chỗ.
+   Khối điều khiển nằm trong PCB (RAM kernel); header block và liên kết free list
+   nằm trong arena nên task sửa được, kernel kiểm tra từng cái trước khi dùng. */
+struct arena_block;
+typedef struct {
+    struct arena_block *free_list; // sắp theo địa chỉ tăng dần
+    uint32_t used;                 // byte đang cấp (kể cả header)
+    uint32_t max_used;
+    uint32_t failed;               // số lần cấp hỏng (hết chỗ hoặc arena bị task ghi hỏng)
+} os_arena_t;
+
+void os_arena_init(os_arena_t *arena, void *base, size_t size); // process_create gọi khi tạo task
+void* os_task_malloc(size_t size);
+void os_task_free(void *ptr);
+
+/* Thống kê heap chung */
+typedef struct {
+    size_t total_bytes;      // payload khi heap rỗng
+    size_t free_bytes;
+    size_t min_free_bytes;   // low-water mark từ lúc boot
+    size_t largest_free;     // block free lớn nhất (< yêu cầu trong khi free_bytes >= yêu cầu: phân mảnh)
+    uint32_t used_blocks;
+    uint32_t free_blocks;
+    uint32_t alloc_count;
+    uint32_t free_count;
+    uint32_t failed_allocs;
+    size_t last_failed_size; // kích thước của lần cấp hỏng gần nhất (đã tính phần đệm căn lề)
+    size_t last_failed_free;    // free_bytes ngay lúc đó
+    size_t last_failed_largest; // block free lớn nhất ngay lúc đó
+} os_heap_stats_t;
+
 size_t os_get_free_heap_size(void);
+void os_heap_get_stats(os_heap_stats_t *stats);
+void os_region_get_stats(size_t *free_bytes, size_t *largest_free);
+void os_heap_print(void);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include "mpu.h"
-#define SCB_ICSR (*(volatile uint32_t*)0xE000ED04)
-#define PENDSVSET_BIT (1UL << 28)
+
+PCB_t *mpu_loaded_pcb = NULL;
 
 void mpu_init(void)
 {
@@ -61,6 +61,18 @@ void mpu_init(void)
     
     uart_print("  Region 5 (Flash mirror): 0x08000000, 256KB\r\n");
 
+    /* Region 7 (vùng chia sẻ) nạp theo từng task ở PendSV. Section .shared là NOLOAD:
+       xóa ở đây, trước khi có task nào chạy */
+    for (uint8_t *p = __shared_start; p < __shared_end; p++) {
+        *p = 0;
+    }
+
+
+    /* MemManage nằm trong dải kernel như ISR gọi API kernel: bị BASEPRI che nên không
+       bao giờ chen vào giữa vùng tới hạn (handler gọi scheduler). Lỗi xảy ra ngay trong
+       vùng tới hạn hoặc lúc PendSV cất context vào guard bị che nên leo thang thành
+       HardFault: HardFault_Handler giải mã MMFSR/MMFAR và báo task gây lỗi. */
+    SCB_SHPR1 = (SCB_SHPR1 & ~0xFFUL) | OS_MAX_SYSCALL_INTERRUPT_PRIORITY;
 
     /* Enable MemManage fault */
     SCB_SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
@@ -72,93 +84,264 @@ void mpu_init(void)
     __ISB();
 }
 
-void mpu_config_for_task(PCB_t *task)
+/* Tìm region MPU nhỏ nhất bao đúng [base, base + size):
+   region là lũy thừa 2 căn tự nhiên; nếu khoảng không phủ kín region thì
+   base và base + size phải rơi đúng biên subregion (region / 8), các subregion
+   nằm ngoài bị tắt bằng SRD. Trả về địa chỉ region trong *rbar, trường SIZE|SRD
+   của RASR trong *rasr_size_srd; 0 nếu không biểu diễn được. */
+int mpu_region_encode(uint32_t base, uint32_t size, uint32_t *rbar, uint32_t *rasr_size_srd)
 {
-    /* Disable MPU during reconfiguration */
-    MPU_CTRL = 0;
-    __DSB();
+    if (size < 32) {
+        return 0;
+    }
+
+    uint32_t end = base + size;
+    uint32_t bits = os_highest_priority(size - 1) + 1; // log2 làm tròn lên
 
-    uint32_t stack_size_bits = mpu_calc_region_size(task->stack_size);
-    uint32_t required_alignment = 1U << (stack_size_bits + 1);
-    if ((uint32_t)task->stack_base % required_alignment != 0)
+    for (; bits < 32; bits++) {
+        uint32_t region_size = 1UL << bits;
+        uint32_t region = base & ~(region_size - 1);
+
+        if (end - region > region_size) {
+            continue; // vượt biên region: thử region gấp đôi
+        }
+
+        uint32_t srd = 0;
+        if (base != region || size != region_size) {
+            if (region_size < MPU_SRD_MIN_REGION) {
+                continue; // region nhỏ không có SRD: chỉ dùng được khi phủ kín
+            }
+            uint32_t sub = region_size / 8;
+            // Subregion của region lớn hơn còn to hơn -> không cần thử tiếp
+            if ((base % sub) != 0 || (end % sub) != 0) {
+                return 0;
+            }
+            uint32_t first = (base - region) / sub;
+            uint32_t last = (end - region) / sub;
+            uint32_t enabled = ((1UL << last) - 1) & ~((1UL << first) - 1);
+            srd = ~enabled & 0xFF;
+        }
+
+        *rbar = region;
+        *rasr_size_srd = (srd << MPU_RASR_SRD_Pos) | ((bits - 1) << MPU_RASR_SIZE_Pos);
+        return 1;
+    }
+    return 0;
+}
+
+/* Tính sẵn RBAR/RASR cho region 1 (stack) và region 2 (heap riêng).
+   Gọi khi tạo task hoặc khi stack/heap của task thay đổi, KHÔNG gọi trong PendSV.
+   RBAR mang sẵn VALID|REGION nên khi nạp không cần ghi MPU_RNR. */
+int mpu_task_regions_init(PCB_t *task)
+{
+    uint32_t stack_region, stack_size_srd;
+    if (!mpu_region_encode(task->stack_base, task->stack_size, &stack_region, &stack_size_srd))
     {
-        uart_print("ERROR: Stack base not aligned!\r\n");
-        return;
+        uart_print("ERROR: Stack not representable by one MPU region!\r\n");
+        return 0;
     }
 
-    /* ===== REGION 1: Task Stack ===== */
-    MPU_RNR = 1;
-    MPU_RBAR = (uint32_t)task->stack_base;
-    MPU_RASR =
+    /* ===== REGION 1: Task Stack (SRD tắt phần region không thuộc stack) ===== */
+    task->mpu_regions[0] = stack_region | MPU_RBAR_VALID_Msk | MPU_TASK_STACK_REGION;
+    task->mpu_regions[1] =
         (1 << MPU_RASR_XN_Pos) |      // No execute (stack should not be executable)
         (3 << MPU_RASR_AP_Pos) |      // Full access (RW)
         (1 << MPU_RASR_TEX_Pos) |     // Normal memory
         (0 << MPU_RASR_C_Pos) |       
         (1 << MPU_RASR_B_Pos) |       
         (0 << MPU_RASR_S_Pos) |       // Unshareable
-        (stack_size_bits << MPU_RASR_SIZE_Pos) |
+        stack_size_srd |
         (1 << MPU_RASR_ENABLE_Pos);
 
-    /* ===== REGION 2: Task Heap/Data ===== */
-    if (task->heap_base && task->heap_size > 0)
+    /* ===== REGION 2: Task Heap/Data (tắt nếu task không có heap riêng,
+       để task mới không thừa hưởng region 2 của task trước) ===== */
+    task->mpu_regions[2] = MPU_RBAR_VALID_Msk | MPU_TASK_HEAP_REGION;
+    task->mpu_regions[3] = 0;
+    uint32_t heap_region, heap_size_srd;
+    if (task->heap_base && task->heap_size > 0 &&
+        mpu_region_encode(task->heap_base, task->heap_size, &heap_region, &heap_size_srd))
     {
-        MPU_RNR = 2;
-        MPU_RBAR = task->heap_base;
-        
-        uint32_t heap_size_bits = mpu_calc_region_size(task->heap_size);
-        MPU_RASR =
+        task->mpu_regions[2] |= heap_region;
+        task->mpu_regions[3] =
             (1 << MPU_RASR_XN_Pos) |  // No execute
             (3 << MPU_RASR_AP_Pos) |  // Full access (RW)
             (1 << MPU_RASR_TEX_Pos) | // Normal memory
             (1 << MPU_RASR_C_Pos) |   
             (1 << MPU_RASR_B_Pos) |   
             (0 << MPU_RASR_S_Pos) |   
-            (heap_size_bits << MPU_RASR_SIZE_Pos) |
+            heap_size_srd |
             (1 << MPU_RASR_ENABLE_Pos);
     }
 
-    /* Re-enable MPU */
-    MPU_CTRL = MPU_CTRL_ENABLE_Msk | MPU_CTRL_PRIVDEFENA_Msk;
-    
+    /* ===== REGION 6: Guard đáy stack - cấm mọi truy cập, kể cả privileged,
+       để tràn stack trong code kernel (thread-path syscall, PendSV cất context)
+       cũng thành MemManage thay vì ghi đè âm thầm ===== */
+    task->mpu_regions[4] = MPU_RBAR_VALID_Msk | MPU_TASK_GUARD_REGION;
+    task->mpu_regions[5] = 0;
+#if OS_STACK_GUARD
+    task->mpu_regions[4] |= task->stack_base;
+    task->mpu_regions[5] =
+        (1 << MPU_RASR_XN_Pos) |
+        (0 << MPU_RASR_AP_Pos) |      // AP=000: không ai truy cập được
+        (1 << MPU_RASR_TEX_Pos) |
+        ((mpu_calc_region_size(OS_STACK_GUARD_SIZE)) << MPU_RASR_SIZE_Pos) |
+        (1 << MPU_RASR_ENABLE_Pos);
+#endif
+
+    /* ===== REGION 7: vùng chia sẻ OS_SHARED, chỉ cho task có OS_CAP_SHARED ===== */
+    task->mpu_regions[6] = MPU_RBAR_VALID_Msk | MPU_SHARED_REGION;
+    task->mpu_regions[7] = 0;
+    if (task->caps & OS_CAP_SHARED) {
+        task->mpu_regions[6] |= (uint32_t)__shared_start;
+        task->mpu_regions[7] =
+            (1 << MPU_RASR_XN_Pos) |
+            (3 << MPU_RASR_AP_Pos) |  // Full access (RW)
+            (1 << MPU_RASR_TEX_Pos) | // Normal memory
+            (1 << MPU_RASR_C_Pos) |
+            (1 << MPU_RASR_B_Pos) |
+            (1 << MPU_RASR_S_Pos) |   // nhiều task dùng chung
+            ((mpu_calc_region_size(OS_SHARED_SIZE)) << MPU_RASR_SIZE_Pos) |
+            (1 << MPU_RASR_ENABLE_Pos);
+    }
+
+    // Giá trị đã đổi: lần đổi ngữ cảnh tới phải nạp lại kể cả khi là cùng task
+    if (mpu_loaded_pcb == task) {
+        mpu_loaded_pcb = NULL;
+    }
+    return 1;
+}
+
+/* Bản C của đường nạp MPU trong PendSV (dùng cho start_first_task).
+   Không tắt MPU: code đang chạy privileged, PRIVDEFENA vẫn cho truy cập. */
+void mpu_config_for_task(PCB_t *task)
+{
+    volatile uint32_t *rbar = &MPU_RBAR;
+
+    rbar[0] = task->mpu_regions[0]; // MPU_RBAR
+    rbar[1] = task->mpu_regions[1]; // MPU_RASR
+    rbar[2] = task->mpu_regions[2]; // MPU_RBAR_A1
+    rbar[3] = task->mpu_regions[3]; // MPU_RASR_A1
+    rbar[4] = task->mpu_regions[4]; // MPU_RBAR_A2
+    rbar[5] = task->mpu_regions[5]; // MPU_RASR_A2
+    rbar[6] = task->mpu_regions[6]; // MPU_RBAR_A3
+    rbar[7] = task->mpu_regions[7]; // MPU_RASR_A3
+    mpu_loaded_pcb = task;
+
     __DSB();  // Data Synchronization Barrier
     __ISB();  // Instruction Synchronization Barrier
 }
 
-void MemManage_Handler(void)
+/* [addr, addr + len) nằm gọn trong [base, base + size), không tràn số */
+static inline int mpu_range_inside(uint32_t addr, uint32_t len, uint32_t base, uint32_t size)
 {
-    uart_print("\r\n*** MPU FAULT ***\r\n");
+    return addr >= base && len <= size && addr - base <= size - len;
+}
+
+/* Đúng những gì MPU cho task unprivileged: stack trên guard (region 1), heap riêng
+   (region 2), vùng chia sẻ nếu có OS_CAP_SHARED (region 7), flash chỉ đọc (region 0).
+   Kernel chạy privileged với PRIVDEFENA nên MPU không chặn hộ: con trỏ sai sẽ thành ghi đè âm thầm vào bộ nhớ kernel. */
+int mpu_task_can_access(const PCB_t *task, const void *addr, uint32_t len, int write)
+{
+    uint32_t a = (uint32_t)addr;
+    uint32_t guard = OS_STACK_GUARD ? OS_STACK_GUARD_SIZE : 0;
+
+    if (mpu_range_inside(a, len, task->stack_base + guard, task->stack_size - guard)) {
+        return 1;
+    }
+    if (task->heap_size > 0 && mpu_range_inside(a, len, task->heap_base, task->heap_size)) {
+        return 1;
+    }
+    if ((task->caps & OS_CAP_SHARED) &&
+        mpu_range_inside(a, len, (uint32_t)__shared_start, OS_SHARED_SIZE)) {
+        return 1;
+    }
+    return !write && mpu_range_inside(a, len, MPU_FLASH_BASE, MPU_FLASH_SIZE);
+}
+
+/* In task đang chạy (tràn stack hay không), MMFSR và địa chỉ lỗi */
+static void mpu_report_fault(uint8_t mmfsr, uint32_t fault_addr)
+{
+    int overflow = 0;
 
     if (current_pcb)
     {
-        uart_print("Task ID: ");
+        /* Tràn stack: chạm guard (địa chỉ lỗi trong OS_STACK_GUARD_SIZE byte đáy)
+           hoặc phần cứng không cất được khung ngắt lên PSP */
+        uint32_t guard_end = current_pcb->stack_base + (OS_STACK_GUARD ? OS_STACK_GUARD_SIZE : 0);
+        if ((mmfsr & SCB_CFSR_MSTKERR_Msk) ||
+            ((mmfsr & SCB_CFSR_MMARVALID_Msk) &&
+             fault_addr >= current_pcb->stack_base - OS_STACK_GUARD_SIZE && fault_addr < guard_end))
+        {
+            overflow = 1;
+        }
+
+        uart_print(overflow ? "STACK OVERFLOW in task " : "Task ID: ");
         uart_print_dec(current_pcb->pid);
-        uart_print("\r\n");
+        uart_print(" (entry 0x");
+        uart_print_hex32((uint32_t)current_pcb->entry);
+        uart_print(", stack 0x");
+        uart_print_hex32(current_pcb->stack_base);
+        uart_print(" + ");
+        uart_print_dec(current_pcb->stack_size);
+        uart_print(")\r\n");
     }
 
-    uint8_t mmfsr = SCB_CFSR & 0xFF;
     uart_print("MMFSR: 0x");
     uart_print_hex(mmfsr);
     uart_print("\r\n");
 
-    if (mmfsr & (1 << 7))  // MMARVALID
+    if (mmfsr & SCB_CFSR_MMARVALID_Msk)
     {
-        uint32_t fault_addr = SCB_MMFAR;
         uart_print("Fault Addr: 0x");
         uart_print_hex32(fault_addr);
         uart_print("\r\n");
     }
+}
+
+void MemManage_Handler(void)
+{
+    uart_print("\r\n*** MPU FAULT ***\r\n");
+    mpu_report_fault(SCB_CFSR & 0xFF, SCB_MMFAR);
 
     /* Clear fault flags */
     SCB_CFSR |= 0xFF;
 
-    /* Suspend faulting task */
+    /* Task không bao giờ chạy lại: đưa PSP lên đỉnh stack của nó để PendSV cất context
+       vào vùng hợp lệ. Nếu để PSP trong guard (tràn stack), lệnh STMDB của PendSV lại
+       chạm guard và fault lồng nhau mãi. PendSV (pend bởi scheduler) tail-chain ngay sau
+       handler này nên khung ngắt trên PSP không bao giờ được unstack. */
     if (current_pcb)
     {
-        current_pcb->state = PROC_SUSPENDED;
-        uart_print("Task suspended\r\n");
-        current_pcb = NULL;
+        uint32_t stack_top = current_pcb->stack_base + current_pcb->stack_size;
+        __asm volatile ("msr psp, %0" : : "r" (stack_top) : "memory");
     }
 
-    SCB_ICSR |= PENDSVSET_BIT;    
-    return;
-}
\ No newline at end of file
+    /* Suspend faulting task, scheduler chọn task khác (task bị treo không quay lại hàng đợi) */
+    process_suspend_current();
+}
+
+/* MemManage bị BASEPRI che (lỗi trong vùng tới hạn của kernel, hoặc PendSV cất
+   context của task vào guard) leo thang thành HardFault. Kernel đang dở vùng tới hạn
+   nên không treo task rồi chạy tiếp được như MemManage_Handler: báo task gây lỗi rồi
+   dừng hệ thống. */
+void HardFault_Handler(void)
+{
+    uint32_t hfsr = SCB_HFSR;
+    uint8_t mmfsr = SCB_CFSR & 0xFF;
+
+    uart_print("\r\n*** HARD FAULT ***\r\nHFSR: 0x");
+    uart_print_hex32(hfsr);
+    uart_print("\r\n");
+
+    if ((hfsr & SCB_HFSR_FORCED_Msk) && mmfsr != 0) {
+        uart_print("Escalated MPU fault (masked in kernel critical section / PendSV)\r\n");
+        mpu_report_fault(mmfsr, SCB_MMFAR);
+    } else if (current_pcb) {
+        uart_print("Task ID: ");
+        uart_print_dec(current_pcb->pid);
+        uart_print("\r\n");
+    }
+
+    while (1) {
+    }
+}
@@ -15,6 +15,20 @@ struct PCB_t; // Forward declaration of PCB_t
 #define MPU_RNR     (*(volatile uint32_t*)(MPU_BASE + 0x08)) // thanh ghi số vùng MPU hiện tại
 #define MPU_RBAR    (*(volatile uint32_t*)(MPU_BASE + 0x0C)) // thanh ghi cơ sở vùng MPU
 #define MPU_RASR    (*(volatile uint32_t*)(MPU_BASE + 0x10)) // thanh ghi thuộc tính vùng MPU
+/* MPU_RBAR_A1..A3 / MPU_RASR_A1..A3 (0x14..0x24) là alias của RBAR/RASR:
+   4 word liên tiếp từ MPU_RBAR nạp được 2 region bằng một lệnh STM */
+
+#define MPU_RBAR_VALID_Msk      (1UL << 4) // RBAR.VALID: dùng trường REGION[3:0] thay cho MPU_RNR
+
+#define MPU_SRD_MIN_REGION      256 // region nhỏ hơn 256 byte không hỗ trợ subregion
+
+#define MPU_TASK_STACK_REGION   1
+#define MPU_TASK_HEAP_REGION    2
+#define MPU_TASK_GUARD_REGION   6 // số lớn hơn region 1 nên thắng khi chồng lấn
+#define MPU_SHARED_REGION       7 // vùng chia sẻ OS_SHARED, chỉ bật cho task có OS_CAP_SHARED
+
+#define MPU_FLASH_BASE          0x00000000UL // region 0: task chỉ đọc
+#define MPU_FLASH_SIZE          (256 * 1024)
 
 /* MPU Control Register */
 #define MPU_CTRL_ENABLE_Msk     (1UL << 0) // Bit kích hoạt MPU
@@ -34,12 +48,17 @@ struct PCB_t; // Forward declaration of PCB_t
 
 /* System Control Block */
 #define SCB_BASE                0xE000ED00 // địa chỉ cơ sở của SCB
+#define SCB_SHPR1               (*(volatile uint32_t*)(SCB_BASE + 0x18)) // ưu tiên MemManage [7:0], BusFault, UsageFault
 #define SCB_SHCSR               (*(volatile uint32_t*)(SCB_BASE + 0x24)) // thanh ghi kiểm soát và trạng thái hệ thống
 #define SCB_CFSR                (*(volatile uint32_t*)(SCB_BASE + 0x28)) // thanh ghi lỗi bảo vệ bộ nhớ
+#define SCB_HFSR                (*(volatile uint32_t*)(SCB_BASE + 0x2C)) // trạng thái HardFault
 #define SCB_MMFAR               (*(volatile uint32_t*)(SCB_BASE + 0x34)) // thanh ghi địa chỉ lỗi bộ nhớ
 
 #define SCB_SHCSR_MEMFAULTENA_Msk   (1UL << 16) // Bit cho phép ngắt lỗi bộ nhớ
 #define SCB_CFSR_MEMFAULTSR_Msk     (0xFFUL) // Mặt nạ lỗi bảo vệ bộ nhớ
+#define SCB_CFSR_MSTKERR_Msk        (1UL << 4) // Lỗi khi cất khung ngắt lên stack (thường là tràn stack)
+#define SCB_CFSR_MMARVALID_Msk      (1UL << 7) // MMFAR chứa địa chỉ lỗi hợp lệ
+#define SCB_HFSR_FORCED_Msk         (1UL << 30) // HardFault do lỗi cấu hình được (MemManage...) bị che nên leo thang
 
 /* Memory barrier instructions */
 #define __DSB() __asm volatile ("dsb" : : : "memory")
@@ -62,7 +81,22 @@ static inline uint32_t mpu_calc_region_size(uint32_t size)
     return value - 1;
 }
 
+/* 1: region của task tính sẵn lúc tạo task, PendSV chỉ nạp 6 word khi đổi sang task khác.
+   0: bản cũ - tính lại region ở mọi lần PendSV rồi nạp lại. Chỉ để benchmark có số
+   "trước" trong cùng cây mã: make bench BENCH_FLAGS=-DOS_MPU_PRECOMPUTE=0 */
+#ifndef OS_MPU_PRECOMPUTE
+#define OS_MPU_PRECOMPUTE 1
+#endif
+
+extern PCB_t *mpu_loaded_pcb; // Task có region 1/2 đang nằm trong MPU (PendSV bỏ qua nếu trùng)
+
 void mpu_init(void);
-void mpu_config_for_task(PCB_t *task);
+int mpu_region_encode(uint32_t base, uint32_t size, uint32_t *rbar, uint32_t *rasr_size_srd);
+int mpu_task_regions_init(PCB_t *task);  // tính sẵn mpu_regions[] từ stack/heap của task, 0 nếu lỗi căn lề
+void mpu_config_for_task(PCB_t *task);   // nạp mpu_regions[] của task vào MPU
+
+/* 1 nếu chính task (unprivileged) truy cập được cả [addr, addr + len) qua region của nó:
+   kernel gọi trước khi đọc/ghi hộ vào con trỏ mà task truyền qua syscall */
+int mpu_task_can_access(const PCB_t *task, const void *addr, uint32_t len, int write);
 
 #endif
\ No newline at end of file
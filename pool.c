@@ -0,0 +1,251 @@
+#include "pool.h"
+#include "process.h"
+#include "memory.h"
+#include "uart.h"
+
+static os_pool_t *pool_list = NULL; // mọi pool đã khởi tạo
+
+/* ============================================================
+   NGUYÊN TỬ BẰNG LDREX/STREX
+   Cortex-M3 xóa exclusive monitor khi vào/ra exception: nếu một ISR chen vào
+   giữa LDREX và STREX (kể cả ISR lấy rồi trả lại đúng block đó - ABA),
+   STREX thất bại và vòng lặp đọc lại từ đầu.
+   ============================================================ */
+static inline uint32_t pool_ldrex(volatile void *addr)
+{
+    uint32_t value;
+    __asm volatile ("ldrex %0, [%1]" : "=r" (value) : "r" (addr) : "memory");
+    return value;
+}
+
+static inline uint32_t pool_strex(uint32_t value, volatile void *addr) // 0: ghi thành công
+{
+    uint32_t failed;
+    __asm volatile ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (addr), "r" (value) : "memory");
+    return failed;
+}
+
+static inline void pool_clrex(void)
+{
+    __asm volatile ("clrex" : : : "memory");
+}
+
+static inline uint32_t pool_atomic_add(volatile uint32_t *addr, int32_t delta) // trả về giá trị mới
+{
+    uint32_t value;
+    do {
+        value = pool_ldrex(addr) + delta;
+    } while (pool_strex(value, addr));
+    return value;
+}
+
+static inline void pool_atomic_max(volatile uint32_t *addr, uint32_t value)
+{
+    do {
+        if (pool_ldrex(addr) >= value) {
+            pool_clrex();
+            return;
+        }
+    } while (pool_strex(value, addr));
+}
+
+/* ============================================================
+   KHỞI TẠO
+   ============================================================ */
+static void pool_register(os_pool_t *pool)
+{
+    OS_ENTER_CRITICAL();
+    os_pool_t *p = pool_list;
+    while (p != NULL && p != pool) {
+        p = p->next;
+    }
+    if (p == NULL) { // init lại cùng một pool: không thêm 2 lần
+        pool->next = pool_list;
+        pool_list = pool;
+    }
+    OS_EXIT_CRITICAL();
+}
+
+/* block_size * block_count không được tràn 32 bit: tích tràn thành số nhỏ thì
+   os_pool_create cấp vùng nhỏ còn os_pool_init xâu block_count block ra ngoài nó */
+int os_pool_size_ok(size_t block_size, uint32_t block_count)
+{
+    if (block_count == 0 || block_count > OS_POOL_MAX_BLOCKS || block_size > HEAP_SIZE) { // chặn trước: OS_POOL_BLOCK_ROUND cũng tràn được
+        return 0;
+    }
+    size_t rounded = OS_POOL_BLOCK_ROUND(block_size);
+    return block_count <= SIZE_MAX / rounded && rounded * block_count <= HEAP_SIZE;
+}
+
+int os_pool_init(os_pool_t *pool, const char *name, void *storage, size_t block_size, uint32_t block_count)
+{
+    if (!os_is_privileged() || pool == NULL || storage == NULL || !os_pool_size_ok(block_size, block_count)) {
+        return 0;
+    }
+    if (((uintptr_t)storage & (OS_POOL_ALIGN - 1)) != 0) {
+        return 0;
+    }
+
+    block_size = OS_POOL_BLOCK_ROUND(block_size);
+
+    pool->name = name;
+    pool->start = (uint8_t *)storage;
+    pool->end = pool->start + block_size * block_count;
+    pool->block_size = block_size;
+    pool->block_count = block_count;
+    pool->from_heap = 0;
+    pool->used = 0;
+    pool->max_used = 0;
+    pool->failed = 0;
+    for (uint32_t i = 0; i < OS_POOL_MAX_BLOCKS / 32; i++) {
+        pool->allocated[i] = 0;
+    }
+
+    /* Xâu các block theo thứ tự địa chỉ: block đầu tiên nằm ở đỉnh stack */
+    os_pool_block_t *head = NULL;
+    for (uint32_t i = block_count; i > 0; i--) {
+        os_pool_block_t *b = (os_pool_block_t *)(pool->start + (i - 1) * block_size);
+        b->next = head;
+        head = b;
+    }
+    pool->free_list = head;
+
+    pool_register(pool);
+    return 1;
+}
+
+int os_pool_create(os_pool_t *pool, const char *name, size_t block_size, uint32_t block_count)
+{
+    if (!os_is_privileged()) {
+        return (int)os_syscall4(SYS_POOL_CREATE, pool, name, block_size, block_count);
+    }
+    if (!os_pool_size_ok(block_size, block_count)) {
+        return 0;
+    }
+
+    void *storage = os_malloc_aligned(OS_POOL_BLOCK_ROUND(block_size) * block_count, OS_POOL_ALIGN);
+    if (storage == NULL) {
+        return 0;
+    }
+    if (!os_pool_init(pool, name, storage, block_size, block_count)) {
+        os_free(storage);
+        return 0;
+    }
+    pool->from_heap = 1;
+    return 1;
+}
+
+/* ============================================================
+   CẤP / TRẢ: không che ngắt, không chặn
+   ============================================================ */
+
+/* Đổi bit cấp phát của block index sang allocated. 0 nếu bit đã như vậy:
+   trả 2 lần, hoặc danh sách rỗi bị ghi hỏng đưa ra block đang được cấp */
+static int pool_mark(os_pool_t *pool, uint32_t index, uint32_t allocated)
+{
+    volatile uint32_t *word = &pool->allocated[index / 32];
+    uint32_t mask = 1UL << (index % 32);
+    uint32_t value;
+    do {
+        value = pool_ldrex(word);
+        if (((value & mask) != 0) == (allocated != 0)) {
+            pool_clrex();
+            return 0;
+        }
+        value ^= mask;
+    } while (pool_strex(value, word));
+    return 1;
+}
+
+static inline uint32_t pool_index(const os_pool_t *pool, const void *block)
+{
+    return (uint32_t)((const uint8_t *)block - pool->start) / pool->block_size;
+}
+
+void *os_pool_alloc(os_pool_t *pool)
+{
+    if (!os_is_privileged()) {
+        return (void *)os_syscall1(SYS_POOL_ALLOC, pool);
+    }
+
+    os_pool_block_t *head;
+    os_pool_block_t *next;
+    do {
+        head = (os_pool_block_t *)pool_ldrex(&pool->free_list);
+        if (head == NULL || !os_pool_contains(pool, head)) {
+            pool_clrex();
+            pool_atomic_add(&pool->failed, 1);
+            return NULL;
+        }
+        next = head->next; // đọc trong cửa sổ exclusive: bị chen thì STREX thất bại
+        if (next != NULL && !os_pool_contains(pool, next)) {
+            pool_clrex(); // liên kết bị ghi đè (block nằm trong vùng task ghi được)
+            pool_atomic_add(&pool->failed, 1);
+            return NULL;
+        }
+    } while (pool_strex((uint32_t)next, &pool->free_list));
+
+    if (!pool_mark(pool, pool_index(pool, head), 1)) {
+        pool_atomic_add(&pool->failed, 1); // block đã được cấp cho người khác: không đưa lần 2
+        return NULL;
+    }
+    pool_atomic_max(&pool->max_used, pool_atomic_add(&pool->used, 1));
+    return head;
+}
+
+int os_pool_contains(const os_pool_t *pool, const void *block)
+{
+    const uint8_t *p = (const uint8_t *)block;
+    return p >= pool->start && p < pool->end && (uint32_t)(p - pool->start) % pool->block_size == 0;
+}
+
+void os_pool_free(os_pool_t *pool, void *block)
+{
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_POOL_FREE, pool, block);
+        return;
+    }
+
+    if (!os_pool_contains(pool, block) || !pool_mark(pool, pool_index(pool, block), 0)) {
+        return; // không phải block của pool này, hoặc block đang rỗi (trả 2 lần)
+    }
+
+    os_pool_block_t *b = (os_pool_block_t *)block;
+    do {
+        b->next = (os_pool_block_t *)pool_ldrex(&pool->free_list);
+    } while (pool_strex((uint32_t)b, &pool->free_list));
+
+    pool_atomic_add(&pool->used, -1);
+}
+
+/* ============================================================
+   THỐNG KÊ: tên, kích thước block, đang dùng / tổng, high-water, số lần hết block
+   ============================================================ */
+void os_pool_print(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_POOL_PRINT);
+        return;
+    }
+
+    uart_print("Name        Block  Used/Total  Max  Fail  Src\r\n");
+    if (pool_list == NULL) {
+        uart_print("  (no pools)\r\n");
+        return;
+    }
+
+    for (os_pool_t *p = pool_list; p != NULL; p = p->next) {
+        uart_print(p->name ? p->name : "?");
+        uart_print("  ");
+        uart_print_dec(p->block_size);
+        uart_print("  ");
+        uart_print_dec(p->used);
+        uart_putc('/');
+        uart_print_dec(p->block_count);
+        uart_print("  ");
+        uart_print_dec(p->max_used);
+        uart_print("  ");
+        uart_print_dec(p->failed);
+        uart_print(p->from_heap ? "  heap\r\n" : "  static\r\n");
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "process.h"
+
+/* Pool block kích thước cố định: cấp/trả O(1), không phân mảnh, gọi được từ ISR.
+   Danh sách block rỗi là một stack liên kết đơn nằm ngay trong block rỗi,
+   đỉnh stack được đổi bằng LDREX/STREX nên không cần che ngắt.
+   Block rỗi của pool trong OS_SHARED thì task ghi đè được liên kết: alloc kiểm tra
+   mọi liên kết trước khi đi theo, và bitmap cấp phát (trong os_pool_t, RAM kernel)
+   chặn trả 2 lần / cấp trùng block. */
+#define OS_POOL_ALIGN 8
+#define OS_POOL_MAX_BLOCKS 128 // kích thước bitmap cấp phát
+
+/* Kích thước thật của 1 block: bội OS_POOL_ALIGN, tối thiểu đủ chứa 1 con trỏ */
+#define OS_POOL_BLOCK_ROUND(size) \
+    ((((size) < sizeof(void *) ? sizeof(void *) : (size)) + OS_POOL_ALIGN - 1) & ~(size_t)(OS_POOL_ALIGN - 1))
+
+/* Vùng nhớ tĩnh cho os_pool_init(): OS_POOL_STORAGE(uart_rx_bufs, 64, 8); */
+#define OS_POOL_STORAGE(name, block_size, block_count) \
+    static uint8_t name[OS_POOL_BLOCK_ROUND(block_size) * (block_count)] __attribute__((aligned(OS_POOL_ALIGN)))
+
+/* Như trên nhưng trong vùng chia sẻ (OS_SHARED, MPU region 7). Vùng của OS_POOL_STORAGE
+   và os_pool_create nằm trong RAM kernel: chỉ kernel/ISR đọc ghi được nội dung block.
+   Pool mà task unprivileged ghi/đọc nội dung block (payload của os_buf_queue_t) phải
+   dùng macro này, và các task đó phải có OS_CAP_SHARED. */
+#define OS_POOL_STORAGE_SHARED(name, block_size, block_count) \
+    static uint8_t name[OS_POOL_BLOCK_ROUND(block_size) * (block_count)] OS_SHARED __attribute__((aligned(OS_POOL_ALIGN)))
+
+typedef struct os_pool_block {
+    struct os_pool_block *next;
+} os_pool_block_t;
+
+typedef struct os_pool {
+    const char *name;
+    os_pool_block_t *volatile free_list; // đỉnh stack block rỗi (chỉ đổi bằng LDREX/STREX)
+    uint8_t *start;                      // [start, end): vùng block, dùng để kiểm tra con trỏ khi free
+    uint8_t *end;
+    uint32_t block_size;                 // đã làm tròn bằng OS_POOL_BLOCK_ROUND
+    uint32_t block_count;
+    uint8_t from_heap;                   // 1: vùng block lấy từ heap_area (os_pool_create)
+    volatile uint32_t allocated[OS_POOL_MAX_BLOCKS / 32]; // bit i = 1: block i đang được cấp
+
+    /* Thống kê (cập nhật nguyên tử) */
+    volatile uint32_t used;              // số block đang được cấp
+    volatile uint32_t max_used;          // high-water mark
+    volatile uint32_t failed;            // số lần os_pool_alloc() gặp pool rỗng
+
+    struct os_pool *next;                // danh sách mọi pool (lệnh shell "pool")
+} os_pool_t;
+
+/* Khởi tạo trên vùng nhớ có sẵn (OS_POOL_STORAGE hoặc tự cấp).
+   Chỉ gọi từ code privileged (main, driver, kernel). Trả về 1 nếu thành công. */
+int os_pool_init(os_pool_t *pool, const char *name, void *storage, size_t block_size, uint32_t block_count);
+
+/* 1 nếu 0 < block_count <= OS_POOL_MAX_BLOCKS và tổng vùng block (sau làm tròn) không tràn, không vượt HEAP_SIZE */
+int os_pool_size_ok(size_t block_size, uint32_t block_count);
+
+/* Lấy vùng block từ heap chung (os_malloc_aligned). Trả về 1 nếu thành công. */
+int os_pool_create(os_pool_t *pool, const char *name, size_t block_size, uint32_t block_count);
+
+/* Thời gian chặn trên, không che ngắt: dùng được trong ISR (UART0_Handler...).
+   Trả về NULL nếu pool rỗng hoặc danh sách block rỗi bị ghi hỏng. */
+void *os_pool_alloc(os_pool_t *pool);
+void os_pool_free(os_pool_t *pool, void *block); // block không thuộc pool / đang rỗi: bỏ qua
+int os_pool_contains(const os_pool_t *pool, const void *block); // 1 nếu block là đầu một block của pool
+
+void os_pool_print(void); // in thống kê mọi pool
+
+#endif
@@ -4,11 +4,15 @@
 #include "memory.h"
 #include <stdint.h>
 #include "mpu.h"
+#include "systick.h"
+#include "dwt.h"
+#include "sync.h"
 
 #define SCB_ICSR (*(volatile uint32_t*)0xE000ED04)
 #define PENDSVSET_BIT (1UL << 28)
 
 volatile uint32_t tick_count = 0;
+volatile uint32_t os_critical_nesting = 0;
 PCB_t *current_pcb = NULL;
 PCB_t *next_pcb = NULL;
 
@@ -21,6 +25,19 @@ queue_t device_queue;
 
 PCB_t pcb_table[MAX_PROCESSES];
 static int total_processes = 0;
+static PCB_t *sleep_list = NULL; // Task đang ngủ, sắp xếp theo thời điểm thức dậy
+static uint8_t priority_time_slice[MAX_PRIORITY]; // Quantum (tick) mặc định cho từng mức ưu tiên
+OS_TASK_STACK(idle_stack, OS_IDLE_STACK_SIZE); // stack tĩnh của idle task (PID 0)
+
+volatile uint32_t context_switch_count = 0;
+volatile uint32_t context_switch_cycles = 0; // PendSV_Handler cộng dồn (context_switch.s)
+static uint32_t last_switch_cycles = 0; // CYCCNT lúc task hiện tại bắt đầu chạy
+
+/* Mẫu đầu cửa sổ đo của lệnh 'top' */
+static uint64_t top_runtime[MAX_PROCESSES];
+static uint32_t top_switches[MAX_PROCESSES];
+static uint32_t top_tick;
+static uint32_t top_context_switches;
 
 const char* process_state_str(process_state_t state) {
     switch (state) {
@@ -37,59 +54,125 @@ void process_init(void) {
     uart_print("Process system initialized.\r\n");
 
     os_mem_init();
-    for(int i = 0; i < MAX_PROCESSES; i++) {
+    dwt_init();
+    for(int i = 0; i < MAX_PRIORITY; i++) {
         queue_init(&ready_queue[i]);
+        priority_time_slice[i] = OS_DEFAULT_TIME_SLICE;
     }
     
     top_ready_priority_bitmap = 0;
+    sleep_list = NULL;
     total_processes = 0;
     current_pcb = NULL;
     next_pcb = NULL;
 
-    process_create(prvIdleTask, 0, 0, NULL);
+    // Idle chỉ chạy wfi: stack tĩnh nhỏ, không lấy từ vùng stack
+    process_create_static(prvIdleTask, 0, 0, NULL, idle_stack, OS_IDLE_STACK_SIZE);
 }
 
 void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res) 
 {
+    process_create_ex(func, pid, priority, max_res, STACK_SIZE * 4);
+}
+
+void process_create_ex(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res,
+                       uint32_t stack_size)
+{
+    process_create_args_t args = {
+        .entry = func, .pid = pid, .priority = priority, .max_res = max_res,
+        .stack_size = stack_size, .stack = NULL, .heap_size = 0, .caps = 0,
+    };
+    process_create_args(&args);
+}
+
+void process_create_static(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res,
+                           uint32_t *stack, uint32_t stack_size)
+{
+    process_create_args_t args = {
+        .entry = func, .pid = pid, .priority = priority, .max_res = max_res,
+        .stack_size = stack_size, .stack = stack, .heap_size = 0, .caps = 0,
+    };
+    process_create_args(&args);
+}
+
+void process_create_args(const process_create_args_t *args)
+{
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_PROCESS_CREATE, args);
+        return;
+    }
+
+    void (*func)(void) = args->entry;
+    uint32_t pid = args->pid;
+    uint8_t priority = args->priority;
+    int *max_res = args->max_res;
+
     if (pid >= MAX_PROCESSES) return;
 
     PCB_t *p = &pcb_table[pid];
-    
-    uint32_t stack_size_bytes = STACK_SIZE * 4;
-    if (stack_size_bytes < 256) stack_size_bytes = 256;
-    
-    stack_size_bytes--;
-    stack_size_bytes |= stack_size_bytes >> 1;
-    stack_size_bytes |= stack_size_bytes >> 2;
-    stack_size_bytes |= stack_size_bytes >> 4;
-    stack_size_bytes |= stack_size_bytes >> 8;
-    stack_size_bytes |= stack_size_bytes >> 16;
-    stack_size_bytes++;
-    
-    uint32_t required_alignment = mpu_calc_alignment(stack_size_bytes);
-    uint32_t *stack_base = (uint32_t*)os_malloc_aligned(stack_size_bytes, required_alignment);
-    
+    uint32_t stack_size_bytes = args->stack_size;
+    uint32_t *stack_base = args->stack;
+
     if (stack_base == NULL) {
-        uart_print("ERROR: Heap full for PID ");
+        /* Stack lấy từ vùng region MPU (buddy, không header, không padding):
+           block căn tự nhiên, phần đuôi không dùng được trả lại và tắt bằng SRD */
+        if (stack_size_bytes < OS_MIN_STACK_SIZE) stack_size_bytes = OS_MIN_STACK_SIZE;
+        stack_size_bytes = os_region_round(stack_size_bytes);
+        stack_base = (uint32_t*)os_region_alloc(stack_size_bytes);
+    
+        if (stack_base == NULL) {
+            size_t region_free, region_largest;
+            os_region_get_stats(&region_free, &region_largest);
+            uart_print("ERROR: Stack pool full for PID ");
+            uart_print_dec(pid);
+            uart_print(" (need ");
+            uart_print_dec(stack_size_bytes);
+            uart_print(", free ");
+            uart_print_dec(region_free);
+            uart_print(", largest ");
+            uart_print_dec(region_largest);
+            uart_print(region_free >= stack_size_bytes ? ": fragmented, see 'heap')\r\n" : ": exhausted, see 'heap')\r\n");
+            return;
+        }
+    } else if (stack_size_bytes < OS_MIN_STACK_SIZE) {
+        uart_print("ERROR: Static stack too small for PID ");
         uart_print_dec(pid);
         uart_print("\r\n");
         return;
     }
     
-    if ((uint32_t)stack_base % required_alignment != 0) {
-        uart_print("ERROR: Stack not aligned! Base=0x");
-        uart_print_hex32((uint32_t)stack_base);
-        uart_print(" Required=");
-        uart_print_dec(required_alignment);
-        uart_print("\r\n");
-        os_free(stack_base);
-        return;
+    /* Heap riêng: một vùng region MPU nữa, chỉ task này truy cập (region 2) */
+    uint32_t heap_size_bytes = 0;
+    void *heap_base = NULL;
+    if (args->heap_size > 0) {
+        heap_size_bytes = os_region_round(args->heap_size);
+        heap_base = os_region_alloc(heap_size_bytes);
+        if (heap_base == NULL) {
+            uart_print("ERROR: No region for private heap of PID ");
+            uart_print_dec(pid);
+            uart_print("\r\n");
+            if (args->stack == NULL) {
+                os_region_free(stack_base, stack_size_bytes);
+            }
+            return;
+        }
+        os_arena_init(&p->arena, heap_base, heap_size_bytes);
     }
-    
+
     p->stack_base = (uint32_t)stack_base;
     p->stack_size = stack_size_bytes;
-    p->heap_base = 0; 
-    p->heap_size = 0;
+    p->heap_base = (uint32_t)heap_base;
+    p->heap_size = heap_size_bytes;
+    p->caps = args->caps; // region 7 phụ thuộc OS_CAP_SHARED
+    if (!mpu_task_regions_init(p)) {
+        if (args->stack == NULL) {
+            os_region_free(stack_base, stack_size_bytes);
+        }
+        os_region_free(heap_base, heap_size_bytes);
+        p->heap_base = 0;
+        p->heap_size = 0;
+        return;
+    }
 
     /* Initialize Banker's algorithm resources */
     for (int i = 0; i < NUM_RESOURCES; i++) {
@@ -97,6 +180,11 @@ void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max
         p->res_max[i] = (max_res != NULL) ? max_res[i] : 0;
     }
 
+    /* Tô toàn bộ stack để đo high-water mark */
+    for (uint32_t i = 0; i < stack_size_bytes / 4; i++) {
+        stack_base[i] = OS_STACK_PAINT;
+    }
+
     /* Calculate stack pointer (grows downward) */
     uint32_t *sp = stack_base + (stack_size_bytes / 4);
 
@@ -113,6 +201,7 @@ void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max
     for (int i = 0; i < 8; ++i) {
         *(--sp) = 0;               /* R11-R4 */
     }
+    *(--sp) = 0x03UL;              /* CONTROL: unprivileged, PSP (PendSV cất/khôi phục theo task) */
 
     /* Initialize PCB */
     p->stack_ptr = sp;
@@ -121,9 +210,18 @@ void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max
     p->state = PROC_NEW;
     p->dynamic_priority = priority;
     p->static_priority = priority;
-    p->time_slice = 5;
+    p->time_quantum = 0;
+    p->time_slice = process_time_quantum(p);
     p->total_cpu_runtime = 0;
+    p->switch_count = 0;
     p->wake_up_tick = 0;
+    p->in_sleep_list = 0;
+    p->blocked_on = NULL;
+    p->held_mutexes = NULL;
+    p->notify_value = 0;
+    p->notify_state = NOTIFY_STATE_NONE;
+
+    p->in_syscall = 0;
 
     /* Add to ready queue */
     OS_ENTER_CRITICAL();
@@ -139,76 +237,357 @@ void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max
     total_processes++;
     
     /* Preempt if higher priority */
-    if (current_pcb && p->dynamic_priority > current_pcb->dynamic_priority) {
-        SCB_ICSR |= PENDSVSET_BIT;
+    process_preempt_check();
+}
+
+/* Số byte stack đã từng dùng: quét từ đáy (bỏ qua guard) tới word đầu tiên
+   không còn mẫu tô. Stack mọc xuống nên phần còn nguyên mẫu nằm ở đáy. */
+uint32_t process_stack_used(PCB_t *p) {
+    uint32_t *bottom = (uint32_t *)p->stack_base;
+    uint32_t words = p->stack_size / 4;
+    uint32_t i = OS_STACK_GUARD ? OS_STACK_GUARD_SIZE / 4 : 0;
+
+    while (i < words && bottom[i] == OS_STACK_PAINT) {
+        i++;
     }
+    return (words - i) * 4;
 }
 
-void process_schedule(void) {
+void process_print_stacks(void) {
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_STACK_PRINT);
+        return;
+    }
+
+    uart_print("PID SIZE  USED  FREE  BASE\r\n");
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        PCB_t *p = &pcb_table[i];
+        if (p->entry == NULL) continue;
+
+        uint32_t usable = p->stack_size - (OS_STACK_GUARD ? OS_STACK_GUARD_SIZE : 0);
+        uint32_t used = process_stack_used(p);
+
+        uart_print_dec(p->pid);
+        uart_print("   ");
+        uart_print_dec(usable);
+        uart_print("  ");
+        uart_print_dec(used);
+        uart_print("  ");
+        uart_print_dec(usable - used);
+        uart_print("  0x");
+        uart_print_hex32(p->stack_base);
+        if (used * 8 > usable * 7) {
+            uart_print("  <- >87%");
+        }
+        uart_print("\r\n");
+    }
+}
+
+/* Task đang giữ CPU: next_pcb nếu đã chọn nhưng PendSV chưa kịp chuyển, ngược lại current_pcb */
+static PCB_t* running_task(void) {
+    if (next_pcb != NULL && next_pcb != current_pcb) {
+        return next_pcb;
+    }
+    return current_pcb;
+}
+
+uint8_t process_time_quantum(PCB_t *p) {
+    uint8_t prio = p->dynamic_priority;
+    if (prio >= MAX_PRIORITY) {
+        prio = MAX_PRIORITY - 1;
+    }
+    return p->time_quantum ? p->time_quantum : priority_time_slice[prio];
+}
+
+void process_set_time_slice(uint32_t pid, uint8_t ticks) {
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_SET_TIME_SLICE, pid, ticks);
+        return;
+    }
+    if (pid >= MAX_PROCESSES) return;
+
     OS_ENTER_CRITICAL();
+    PCB_t *p = &pcb_table[pid];
+    p->time_quantum = ticks;
+    p->time_slice = process_time_quantum(p);
+    OS_EXIT_CRITICAL();
+}
 
-    if (top_ready_priority_bitmap == 0) {
-        OS_EXIT_CRITICAL();  
+void process_set_priority_time_slice(uint8_t priority, uint8_t ticks) {
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_SET_PRIO_TIME_SLICE, priority, ticks);
         return;
     }
+    if (priority >= MAX_PRIORITY || ticks == 0) return;
+
+    OS_ENTER_CRITICAL();
+    priority_time_slice[priority] = ticks;
+    OS_EXIT_CRITICAL();
+}
+
+/* Nhường CPU: task đang chạy (nếu còn RUNNING) về cuối hàng đợi của nó,
+   sau đó chọn task READY có ưu tiên cao nhất (có thể chính là nó). */
+void process_schedule(void) {
+    OS_ENTER_CRITICAL();
+
+    PCB_t *prev = running_task();
+    if (prev != NULL && prev->state == PROC_RUNNING) {
+        prev->state = PROC_READY;
+        add_task_to_ready_queue(prev);
+    }
 
     PCB_t *pnext = get_highest_priority_ready_task();
     if (!pnext) {
         OS_EXIT_CRITICAL(); 
         return;
     }
+    pnext->state = PROC_RUNNING;
 
-    if (current_pcb != NULL && current_pcb->state == PROC_RUNNING) {
-        current_pcb->state = PROC_READY;
-        add_task_to_ready_queue(current_pcb);
+    /* MPU config happens in start_first_task() or PendSV_Handler */
+    if (current_pcb == NULL) {
+        current_pcb = pnext;
+        last_switch_cycles = dwt_get_cycles();
+        pnext->switch_count++;
+        context_switch_count++;
+        OS_EXIT_CRITICAL();
+        start_first_task(current_pcb);
+        return;
     }
 
-    pnext->state = PROC_RUNNING;
-    OS_EXIT_CRITICAL();  
+    next_pcb = pnext;
+    OS_EXIT_CRITICAL();
 
-    uart_print("Switching to process ");
-    uart_print_dec(pnext->pid);
-    uart_print(" (");
-    uart_print(process_state_str(pnext->state));
-    uart_print(")\r\n");
+    if (pnext != current_pcb) {
+#if OS_TRACE_SWITCH
+        uart_print("Switching to process ");
+        uart_print_dec(pnext->pid);
+        uart_print(" (");
+        uart_print(process_state_str(pnext->state));
+        uart_print(")\r\n");
+#endif
+        SCB_ICSR |= PENDSVSET_BIT;
+    }
+}
 
-    /* MPU config happens in start_first_task() or PendSV_Handler */
+/* Gọi từ PendSV_Handler trước khi đổi current_pcb: cộng số chu kỳ DWT
+   task cũ vừa chạy vào total_cpu_runtime của nó. */
+void process_account_switch(PCB_t *next) {
+#if !OS_MPU_PRECOMPUTE
+    mpu_task_regions_init(next); // đường cũ: tính lại region ở mọi lần PendSV, mpu_loaded_pcb bị xóa nên nạp lại luôn
+#endif
+    if (next == current_pcb) {
+        return; // Chọn lại chính task đang chạy, không có lần đổi ngữ cảnh nào
+    }
+
+    uint32_t now = dwt_get_cycles();
+    if (current_pcb != NULL) {
+        current_pcb->total_cpu_runtime += now - last_switch_cycles;
+    }
+    last_switch_cycles = now;
+    next->switch_count++;
+    context_switch_count++;
+}
+
+void process_get_switch_stats(os_switch_stats_t *stats) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_SWITCH_STATS, stats);
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    stats->switches = context_switch_count;
+    stats->pendsv_cycles = context_switch_cycles;
+    OS_EXIT_CRITICAL();
+}
+
+/* Số chu kỳ task đã chạy, tính cả phần đang chạy dở của task hiện tại */
+static uint64_t process_runtime(PCB_t *p) {
+    uint64_t runtime = p->total_cpu_runtime;
+    if (p == current_pcb) {
+        runtime += dwt_get_cycles() - last_switch_cycles;
+    }
+    return runtime;
+}
+
+/* Chỉ chuyển task khi có task READY ưu tiên cao hơn task đang chạy */
+void process_preempt_check(void) {
     if (current_pcb == NULL) {
-        current_pcb = pnext;
-        start_first_task(current_pcb);  
+        return; // Scheduler chưa khởi động
+    }
+
+    OS_ENTER_CRITICAL();
+    PCB_t *run = running_task();
+    int need_schedule = top_ready_priority_bitmap != 0 &&
+        (run == NULL || run->state != PROC_RUNNING ||
+         os_highest_priority(top_ready_priority_bitmap) > run->dynamic_priority);
+    OS_EXIT_CRITICAL();
+
+    if (need_schedule) {
+        process_schedule();
+    }
+}
+
+/* Chèn task vào danh sách ngủ: O(n) nhưng chạy ở ngữ cảnh task, không phải trong ISR.
+   Task thức cùng tick được xếp sau nhau theo thứ tự FIFO. */
+static void sleep_list_insert(PCB_t *p, uint32_t ticks) {
+    PCB_t *prev = NULL;
+    PCB_t *cur = sleep_list;
+
+    while (cur && cur->sleep_delta <= ticks) {
+        ticks -= cur->sleep_delta;
+        prev = cur;
+        cur = cur->sleep_next;
+    }
+
+    p->sleep_delta = ticks;
+    p->sleep_prev = prev;
+    p->sleep_next = cur;
+    if (cur) {
+        cur->sleep_delta -= ticks;
+        cur->sleep_prev = p;
+    }
+    if (prev) {
+        prev->sleep_next = p;
     } else {
-        next_pcb = pnext;
-        SCB_ICSR |= PENDSVSET_BIT;
+        sleep_list = p;
     }
+    p->in_sleep_list = 1;
 }
 
-void os_delay(uint32_t ticks) {
-    current_pcb->wake_up_tick = tick_count + ticks;
+static void sleep_list_remove(PCB_t *p) {
+    if (!p->in_sleep_list) {
+        return;
+    }
+
+    if (p->sleep_next) {
+        p->sleep_next->sleep_delta += p->sleep_delta;
+        p->sleep_next->sleep_prev = p->sleep_prev;
+    }
+    if (p->sleep_prev) {
+        p->sleep_prev->sleep_next = p->sleep_next;
+    } else {
+        sleep_list = p->sleep_next;
+    }
+
+    p->sleep_next = NULL;
+    p->sleep_prev = NULL;
+    p->in_sleep_list = 0;
+}
+
+/* Chuyển task hiện tại sang BLOCKED, có hạn chờ `timeout` tick (OS_WAIT_FOREVER: không hạn).
+   Gọi khi đã tắt ngắt; nếu chờ tài nguyên thì task phải đã nằm trong wait list.
+   Hàm gọi tự thoát critical rồi gọi process_schedule(). */
+void process_block_current(uint32_t timeout) {
     current_pcb->state = PROC_BLOCKED;
+    current_pcb->wait_status = OS_OK;
+    if (timeout != OS_WAIT_FOREVER) {
+        current_pcb->wake_up_tick = tick_count + timeout;
+        sleep_list_insert(current_pcb, timeout);
+    }
+}
+
+/* Đánh thức task đang BLOCKED với kết quả `status`. Gọi khi đã tắt ngắt:
+   gỡ khỏi wait list và danh sách ngủ trong cùng vùng tới hạn nên không thể
+   vừa hết hạn vừa được trao tài nguyên. */
+void process_wake_task(PCB_t *p, os_status_t status) {
+    queue_remove(p);
+    sleep_list_remove(p);
+
+    p->wait_status = status;
+    p->wake_up_tick = 0;
+    p->blocked_on = NULL;
+    p->state = PROC_READY;
+    add_task_to_ready_queue(p);
+}
+
+void os_delay(uint32_t ticks) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_DELAY, ticks);
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    process_block_current(ticks);
+    OS_EXIT_CRITICAL();
+
     process_schedule();
 }
 
 void process_timer_tick(void) {
-    tick_count++;
     int need_schedule = 0;
-    
-    OS_ENTER_CRITICAL();  
-    
-    for (int i = 0; i < MAX_PROCESSES; i++) {
-        PCB_t *p = &pcb_table[i];
-        
-        if (p->state == PROC_BLOCKED && p->wake_up_tick <= tick_count) {
-            p->state = PROC_READY;
-            p->wake_up_tick = 0;
-            add_task_to_ready_queue(p);
+
+    OS_ENTER_CRITICAL();
+    tick_count++;
+
+    /* Chỉ cần xem đầu danh sách: O(1) mỗi tick, bất kể bao nhiêu task đang ngủ */
+    if (sleep_list && sleep_list->sleep_delta > 0) {
+        sleep_list->sleep_delta--;
+    }
+    while (sleep_list && sleep_list->sleep_delta == 0) {
+        PCB_t *p = sleep_list;
+        struct os_mutex *mtx = p->blocked_on;
+
+        /* Còn nằm trong wait list nghĩa là hết hạn chờ tài nguyên.
+           Hết hạn notify_wait: bỏ WAITING ngay tại đây, không đợi task chạy lại,
+           để notify_give từ ISR trong khoảng đó không đưa task READY vào ready
+           queue lần nữa (notify_wait nhận ra hết hạn vì state != PENDING) */
+        if (p->notify_state == NOTIFY_STATE_WAITING) {
+            p->notify_state = NOTIFY_STATE_NONE;
+        }
+        process_wake_task(p, p->qnode.owner ? OS_ERR_TIMEOUT : OS_OK);
+        if (mtx != NULL) {
+            mutex_wait_aborted(mtx); // Owner không còn được kế thừa từ task này
+        }
+    }
+
+    /* Round-robin: task giữ CPU cho tới khi hết quantum hoặc tự block.
+       Hết quantum mà không có task cùng mức đang chờ thì chạy tiếp, không đổi ngữ cảnh. */
+    PCB_t *run = running_task();
+    if (run == NULL || run->state != PROC_RUNNING) {
+        need_schedule = (top_ready_priority_bitmap != 0);
+    } else {
+        if (run->time_slice > 0) {
+            run->time_slice--;
+        }
+        if (run->time_slice == 0) {
+            run->time_slice = process_time_quantum(run);
+            if (!queue_is_empty(&ready_queue[run->dynamic_priority])) {
+                need_schedule = 1;
+            }
+        }
+        if (top_ready_priority_bitmap != 0 &&
+            os_highest_priority(top_ready_priority_bitmap) > run->dynamic_priority) {
             need_schedule = 1;
         }
     }
-    
-    OS_EXIT_CRITICAL(); 
-    
+
+    OS_EXIT_CRITICAL();
+
     if (need_schedule) {
-        SCB_ICSR |= PENDSVSET_BIT;
+        process_schedule();
+    }
+}
+
+/* Số tick hệ thống có thể rảnh (chỉ idle chạy được). Gọi khi đã tắt ngắt.
+   0: có task khác đang READY, không được bỏ tick. */
+uint32_t process_idle_expected_ticks(void) {
+    if (top_ready_priority_bitmap != 0) {
+        return 0;
+    }
+    if (sleep_list == NULL) {
+        return 0xFFFFFFFFUL;
+    }
+    return sleep_list->sleep_delta;
+}
+
+/* Bù các tick đã bỏ qua khi ngủ tickless. ticks luôn nhỏ hơn delta của task đầu
+   danh sách ngủ, nên không task nào bị trễ hạn; tick cuối do SysTick_Handler xử lý. */
+void process_step_tick(uint32_t ticks) {
+    tick_count += ticks;
+    if (sleep_list) {
+        if (sleep_list->sleep_delta > ticks) {
+            sleep_list->sleep_delta -= ticks;
+        } else {
+            sleep_list->sleep_delta = 1;
+        }
     }
 }
 
@@ -223,21 +602,185 @@ void add_task_to_ready_queue(PCB_t *p) {
     top_ready_priority_bitmap |= (1UL << prio);
 }
 
+void remove_task_from_ready_queue(PCB_t *p) {
+    queue_t *q = p->qnode.owner;
+    if (q == NULL) {
+        return;
+    }
+
+    queue_remove(p);
+    if (q >= &ready_queue[0] && q < &ready_queue[MAX_PRIORITY] && queue_is_empty(q)) {
+        top_ready_priority_bitmap &= ~(1UL << (q - ready_queue));
+    }
+}
+
+/* Đổi ưu tiên động (dùng cho priority inheritance). Gọi khi đã tắt ngắt.
+   Task đang READY được chuyển sang đúng ready queue của mức mới,
+   task đang chờ được xếp lại vị trí trong wait list (sắp theo ưu tiên). */
+void process_set_dynamic_priority(PCB_t *p, uint8_t priority) {
+    if (priority >= MAX_PRIORITY) {
+        priority = MAX_PRIORITY - 1;
+    }
+    if (p->dynamic_priority == priority) {
+        return;
+    }
+
+    queue_t *q = p->qnode.owner;
+    if (q >= &ready_queue[0] && q < &ready_queue[MAX_PRIORITY]) {
+        remove_task_from_ready_queue(p);
+        p->dynamic_priority = priority;
+        add_task_to_ready_queue(p);
+    } else if (q != NULL) {
+        queue_remove(p);
+        p->dynamic_priority = priority;
+        queue_insert_by_priority(q, p);
+    } else {
+        p->dynamic_priority = priority;
+    }
+}
+
+/* Nhường CPU cho task khác cùng mức ưu tiên (nếu có) */
+void os_yield(void) {
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_YIELD);
+        return;
+    }
+    process_schedule();
+}
+
+/* Treo task đang chạy vì lỗi của chính nó (MPU fault, tham số syscall sai):
+   task không quay lại hàng đợi nào, scheduler chọn task khác */
+void process_suspend_current(void) {
+    if (current_pcb != NULL) {
+        current_pcb->state = PROC_SUSPENDED;
+        uart_print("Task ");
+        uart_print_dec(current_pcb->pid);
+        uart_print(" suspended\r\n");
+    }
+    process_schedule();
+}
+
 PCB_t* get_highest_priority_ready_task() {
-    for (int prio = MAX_PRIORITY - 1; prio >= 0; prio--) {
-        if (top_ready_priority_bitmap & (1UL << prio)) {
-            PCB_t *p = queue_dequeue(&ready_queue[prio]);
-            if (queue_is_empty(&ready_queue[prio])) {
-                top_ready_priority_bitmap &= ~(1UL << prio);
-            }
-            return p;
+    if (top_ready_priority_bitmap == 0) {
+        return NULL;
+    }
+
+    uint32_t prio = os_highest_priority(top_ready_priority_bitmap);
+    PCB_t *p = queue_dequeue(&ready_queue[prio]);
+    if (queue_is_empty(&ready_queue[prio])) {
+        top_ready_priority_bitmap &= ~(1UL << prio);
+    }
+    return p;
+}
+
+/* ============================================================
+   LỆNH 'top': lấy mẫu đầu cửa sổ, sau đó in % CPU trong cửa sổ đó
+   ============================================================ */
+void process_top_begin(void) {
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_TOP_BEGIN);
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        top_runtime[i] = process_runtime(&pcb_table[i]);
+        top_switches[i] = pcb_table[i].switch_count;
+    }
+    top_tick = tick_count;
+    top_context_switches = context_switch_count;
+    OS_EXIT_CRITICAL();
+}
+
+/* part / whole theo phần nghìn. Không có libgcc nên không chia 64 bit: dịch cả hai
+   sang phải tới khi whole < 2^22 (part * 1000 vẫn vừa 32 bit), sai số < 0.1%. */
+static uint32_t top_permille(uint64_t part, uint64_t whole) {
+    while (whole >= (1UL << 22)) {
+        part >>= 1;
+        whole >>= 1;
+    }
+    if (whole == 0) {
+        return 0;
+    }
+    if (part > whole) {
+        part = whole;
+    }
+    return (uint32_t)part * 1000 / (uint32_t)whole;
+}
+
+static void print_permille(uint32_t permille) {
+    uart_print_dec(permille / 10);
+    uart_putc('.');
+    uart_print_dec(permille % 10);
+    uart_print("%");
+}
+
+void process_print_top(void) {
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_TOP_PRINT);
+        return;
+    }
+    uint64_t runtime[MAX_PROCESSES];
+    uint32_t switches[MAX_PROCESSES];
+
+    OS_ENTER_CRITICAL();
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        runtime[i] = process_runtime(&pcb_table[i]) - top_runtime[i];
+        switches[i] = pcb_table[i].switch_count - top_switches[i];
+    }
+    uint32_t window_ticks = tick_count - top_tick;
+    uint32_t window_switches = context_switch_count - top_context_switches;
+    OS_EXIT_CRITICAL();
+
+    if (window_ticks == 0) {
+        window_ticks = 1;
+    }
+    /* Cửa sổ tính theo tick (SysTick vẫn đúng giờ khi CPU ngủ WFI, CYCCNT thì không).
+       64 bit: 8 000 000 chu kỳ/tick thì 32 bit tràn sau ~536 tick */
+    uint64_t window_cycles = (uint64_t)window_ticks * systick_get_period();
+
+    uart_print("PID PRIO STATE      CPU     SWITCHES\r\n");
+    uint64_t busy = 0;
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        PCB_t *p = &pcb_table[i];
+        if (p->entry == NULL) continue;
+
+        uint32_t permille = top_permille(runtime[i], window_cycles);
+        if (i != 0) {
+            busy += runtime[i];
         }
+
+        uart_print_dec(p->pid);
+        uart_print("   ");
+        uart_print_dec(p->dynamic_priority);
+        uart_print("    ");
+        uart_print(process_state_str(p->state));
+        uart_print("  ");
+        print_permille(permille);
+        uart_print("  ");
+        uart_print_dec(switches[i]);
+        uart_print(" / ");
+        uart_print_dec(p->switch_count);
+        uart_print("\r\n");
     }
-    return NULL;
+
+    /* Idle = phần còn lại của cửa sổ: gồm cả thời gian prvIdleTask ngủ trong WFI */
+    uint64_t idle = (busy < window_cycles) ? window_cycles - busy : 0;
+    uint32_t ticks_per_sec = OS_CPU_CLOCK_HZ / systick_get_period();
+    uart_print("Idle: ");
+    print_permille(top_permille(idle, window_cycles));
+    uart_print("  Ctx switches/s: ");
+    uart_print_dec(window_switches * ticks_per_sec / window_ticks);
+    uart_print("  Total switches: ");
+    uart_print_dec(context_switch_count);
+    uart_print("\r\n");
 }
 
 void prvIdleTask(void) {
     while (1) {
+#if OS_USE_TICKLESS_IDLE
+        systick_tickless_idle();
+#else
         __asm("wfi");
+#endif
     }
 }
\ No newline at end of file
@@ -3,22 +3,120 @@
 #include <stdint.h>
 #include "queue.h"
 #include "banker.h"
+#include "critprof.h"
+#include "svc.h"
+#include "memory.h"
 
-#define MAX_PROCESSES 10 // Số lượng tiến trình tối đa
-#define MAX_PRIORITY 8 // số hàng đợi tối đa
-#define STACK_SIZE 256 // Kích thước stack cho mỗi tiến trình
+#define MAX_PROCESSES 16 // Số lượng tiến trình tối đa
+#define MAX_PRIORITY 32 // số hàng đợi tối đa (tối đa 32 = số bit của bitmap)
+#define STACK_SIZE 256 // Kích thước stack mặc định (word) cho process_create()
+#define OS_MIN_STACK_SIZE 256  // byte: đủ cho khung ngắt + context (17 word) và vài lời gọi hàm
+#define OS_IDLE_STACK_SIZE 256 // byte: idle task chỉ gọi wfi / tickless idle
 
-// Lệnh Assembly để tắt ngắt (Set PRIMASK = 1)
-#define OS_ENTER_CRITICAL()  __asm volatile ("cpsid i" : : : "memory")
-// Lệnh Assembly để bật lại ngắt (Set PRIMASK = 0)
-#define OS_EXIT_CRITICAL()   __asm volatile ("cpsie i" : : : "memory")
+#define OS_STACK_PAINT 0xA5A5A5A5UL // Mẫu tô stack lúc tạo task: word còn nguyên mẫu = chưa từng dùng
+#define OS_STACK_GUARD 1            // 1: OS_STACK_GUARD_SIZE byte thấp nhất của stack là vùng cấm (MPU region 6)
+#define OS_STACK_GUARD_SIZE 32      // = region MPU nhỏ nhất
+
+#define OS_CPU_CLOCK_HZ 80000000UL      // clock CPU (Hz), dùng để quy đổi chu kỳ DWT ra thời gian
+
+#define OS_DEFAULT_TIME_SLICE 5         // quantum round-robin mặc định (tick) cho mỗi mức ưu tiên
+
+#define OS_USE_TICKLESS_IDLE 1          // 1: idle task tắt SysTick định kỳ, ngủ tới deadline gần nhất
+#define OS_TICKLESS_MIN_IDLE_TICKS 2    // chỉ vào tickless khi rảnh ít nhất từng này tick
+
+/* Quyền riêng của task (PCB.caps), cấp lúc tạo task qua process_create_args_t.caps.
+   Task tạo task con chỉ cấp được những quyền chính nó có. */
+#define OS_CAP_REBOOT   (1U << 0)       // được gọi os_reboot()
+#define OS_CAP_SHARED   (1U << 1)       // đọc/ghi được vùng chia sẻ OS_SHARED (MPU region 7)
+#define OS_CAP_SCHED    (1U << 2)       // đổi time slice của task khác / của cả một mức ưu tiên
+#define OS_CAP_SYNC_INIT (1U << 3)      // init (lại) semaphore / mutex từ task
+
+#define OS_TRACE_SWITCH 0               // 1: in mỗi lần đổi task ra UART (chỉ để debug: print chặn làm lệch time slice và benchmark)
+
+/* Mức ưu tiên ngắt (LM3S6965 có 3 bit ưu tiên: 0x00, 0x20, ..., 0xE0; số nhỏ = ưu tiên cao).
+   ISR gọi API kernel phải có mức >= OS_MAX_SYSCALL_INTERRUPT_PRIORITY.
+   ISR có mức < OS_MAX_SYSCALL_INTERRUPT_PRIORITY không bao giờ bị kernel che
+   (zero-latency) nhưng tuyệt đối không được gọi API kernel. */
+#define OS_KERNEL_INTERRUPT_PRIORITY       0xE0 // SysTick, PendSV: thấp nhất
+#define OS_MAX_SYSCALL_INTERRUPT_PRIORITY  0x40
+
+extern volatile uint32_t os_critical_nesting; // Độ sâu lồng nhau của vùng tới hạn
+
+/* Vùng tới hạn bằng BASEPRI, lồng nhau được: chỉ che các ngắt có mức
+   >= OS_MAX_SYSCALL_INTERRUPT_PRIORITY, chỉ bỏ che khi thoát lớp ngoài cùng. */
+static inline void os_enter_critical(void)
+{
+    uint32_t basepri = OS_MAX_SYSCALL_INTERRUPT_PRIORITY;
+    __asm volatile ("msr basepri, %0\n"
+                    "dsb\n"
+                    "isb" : : "r" (basepri) : "memory");
+    os_critical_nesting++;
+}
+
+static inline void os_exit_critical(void)
+{
+    if (--os_critical_nesting == 0) {
+        __asm volatile ("msr basepri, %0" : : "r" (0) : "memory");
+    }
+}
+
+/* Privileged khi đang trong handler (IPSR != 0) hoặc CONTROL.nPRIV = 0 */
+static inline int os_is_privileged(void)
+{
+    uint32_t ipsr, control;
+    __asm volatile ("mrs %0, ipsr" : "=r" (ipsr));
+    __asm volatile ("mrs %0, control" : "=r" (control));
+    return (ipsr != 0) || ((control & 1UL) == 0);
+}
+
+#if OS_CRITICAL_PROFILE
+static inline void os_enter_critical_at(os_crit_site_t *site)
+{
+    os_enter_critical();
+    if (os_critical_nesting == 1) {
+        crit_profile_begin(site);
+    }
+}
+
+static inline void os_exit_critical_profiled(void)
+{
+    if (os_critical_nesting == 1) {
+        crit_profile_end();
+    }
+    os_exit_critical();
+}
+
+/* Mỗi chỗ gọi có một bản ghi static riêng (file, dòng) */
+#define OS_ENTER_CRITICAL() do { \
+        static os_crit_site_t _crit_site = { __FILE__, __LINE__, 0, NULL, 0, 0, {0} }; \
+        os_enter_critical_at(&_crit_site); \
+    } while (0)
+#define OS_EXIT_CRITICAL()   os_exit_critical_profiled()
+#else
+#define OS_ENTER_CRITICAL()  os_enter_critical()
+#define OS_EXIT_CRITICAL()   os_exit_critical()
+#endif
+
+/* Kết quả của các hàm chờ có timeout */
+typedef enum {
+    OS_OK = 0,              // Lấy được tài nguyên
+    OS_ERR_TIMEOUT = -1,    // Hết thời gian chờ
+    OS_ERR_WOULD_BLOCK = -2,// Dạng *_try: tài nguyên đang bận, không chờ
+    OS_ERR_PARAM = -3       // Tham số không hợp lệ
+} os_status_t;
+
+#define OS_WAIT_FOREVER 0xFFFFFFFFUL // Chờ vô hạn
+#define OS_NO_WAIT      0UL          // Không chờ (dạng *_try)
 
 extern queue_t ready_queue[MAX_PRIORITY]; // mảng hàng đợi
 extern queue_t job_queue; // Hàng đợi công việc (nếu cần, có thể bỏ qua nếu không dùng)
 extern queue_t device_queue; // Hàng đợi công việc và thiết bị (nếu cần)
 extern struct PCB* current_pcb; // PCB hiện tại
+struct os_mutex;
 extern volatile uint32_t tick_count; // Biến đếm tick hệ thống
 extern uint32_t top_ready_priority_bitmap; // ví dụ = 3 => 0000 1000
+extern volatile uint32_t context_switch_count; // Tổng số lần đổi ngữ cảnh
+extern volatile uint32_t context_switch_cycles; // Tổng chu kỳ DWT nằm trong PendSV_Handler (từ lúc vào tới khi nạp xong task mới)
 
 typedef enum {
     PROC_NEW,
@@ -31,49 +129,156 @@ typedef enum {
 typedef struct PCB {
     /* --- PHẦN CỐT LÕI (Context Switching) --- */
     uint32_t *stack_ptr;       // Con trỏ stack (quan trọng nhất)
+    /* RBAR/RASR của region 1 (stack), region 2 (heap riêng), region 6 (guard đáy stack)
+       và region 7 (vùng chia sẻ), tính sẵn khi tạo task. PendSV ghi thẳng 8 word này
+       vào MPU_RBAR..MPU_RASR_A3 bằng một lệnh STM. PHẢI nằm ở offset 4 (context_switch.s). */
+    uint32_t mpu_regions[8];
+    queue_node_t qnode;        // Nút liên kết cho ready queue / wait list
     
     /* --- PHẦN ĐỊNH DANH --- */
     uint32_t pid;              // ID tiến trình
     void (*entry)(void);       // Hàm main của task (để debug hoặc reset task)
+    uint8_t caps;              // OS_CAP_*
     
     /* --- PHẦN TRẠNG THÁI & BLOCKING --- */
     process_state_t state;     // READY, RUNNING, BLOCKED...
     uint32_t wake_up_tick;     // [QUAN TRỌNG] Phải là uint32_t để tránh tràn số
-                               // Thời điểm (tick hệ thống) mà task sẽ thức dậy
+                               // Thời điểm (tick hệ thống) mà task sẽ thức dậy (chỉ để hiển thị)
+
+    /* Danh sách ngủ (delta list): sleep_delta = số tick sau task đứng trước nó.
+       Không so sánh tick tuyệt đối nên không bị lỗi khi tick_count tràn. */
+    struct PCB *sleep_next;
+    struct PCB *sleep_prev;
+    uint32_t sleep_delta;
+    uint8_t in_sleep_list;     // 1: đang nằm trong danh sách ngủ
+    int8_t wait_status;        // Kết quả lần chờ gần nhất (os_status_t)
+
+    /* --- PHẦN SYSTEM CALL (thread path: task đang chạy hàm kernel ở privileged) --- */
+    uint8_t in_syscall;        // 1: đang ở giữa một thread-path syscall
+    uint32_t svc_return_pc;    // Chỗ quay về sau khi hàm kernel xong
+    uint32_t svc_return_lr;
+
+    /* --- PHẦN NOTIFICATION (ISR -> task, không cần kernel object riêng) --- */
+    uint32_t notify_value;     // Giá trị thông báo
+    uint8_t notify_state;      // NOTIFY_STATE_*
 
     /* --- PHẦN LẬP LỊCH (SCHEDULING) --- */
     uint8_t static_priority;     // Độ ưu tiên gốc (Cài đặt ban đầu)
     uint8_t dynamic_priority;  // Độ ưu tiên động (Dùng để lập lịch thực tế)
     
     uint8_t time_slice;        // Số tick còn lại trong lượt chạy hiện tại (Round-robin quota)
+    uint8_t time_quantum;      // Quantum riêng của task (0: dùng quantum của mức ưu tiên)
     
     /* --- PHẦN THỐNG KÊ (Tùy chọn) --- */
-    uint32_t total_cpu_runtime; // Tổng số tick task này đã chiếm dụng từ lúc khởi động
-                                // Dùng uint32_t để không bị tràn sớm
+    uint64_t total_cpu_runtime; // Tổng số chu kỳ CPU (DWT CYCCNT) task đã chạy, cộng dồn ở mỗi lần đổi ngữ cảnh
+                                // 64 bit: CYCCNT 32 bit tràn sau ~53s ở 80MHz
+    uint32_t switch_count;      // Số lần task được đưa lên CPU
     uint8_t id_cpu;           // CPU chạy task này (dành cho hệ thống đa lõi)
 
+    /* --- PHẦN MUTEX (Priority inheritance) --- */
+    struct os_mutex *blocked_on;   // Mutex task đang chờ (NULL nếu không chờ mutex)
+    struct os_mutex *held_mutexes; // Danh sách mutex task đang giữ
+
     /* --- PHẦN QUẢN LÝ TÀI NGUYÊN (RESOURCE MANAGEMENT) --- */
     int res_held[NUM_RESOURCES]; // Số lượng tài nguyên đang giữ
     int res_max[NUM_RESOURCES]; // Số lượng tài nguyên tối đa có thể yêu cầu
 
     uint32_t heap_base;    // Địa chỉ cơ sở của heap
     uint32_t heap_size;    // Kích thước của heap
+    os_arena_t arena;      // Khối điều khiển heap riêng (không nằm trong region 2 task ghi được)
     uint32_t stack_base;   // Địa chỉ cơ sở của stack
     uint32_t stack_size;   // Kích thước của stack
 } PCB_t;
 
 extern PCB_t pcb_table[MAX_PROCESSES];
 
+_Static_assert(__builtin_offsetof(PCB_t, mpu_regions) == 4, "context_switch.s: PCB mpu_regions phai o offset 4");
+
 
 void process_init(void);
-void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res);
+/* Khai báo stack tĩnh cho process_create_static(): nằm trong section .task_stacks
+   (linker.ld, không xóa lúc boot), căn theo chính kích thước nên luôn vừa một
+   region MPU. bytes phải là lũy thừa 2 và >= OS_MIN_STACK_SIZE. */
+#define OS_TASK_STACK(name, bytes) \
+    static uint32_t name[(bytes) / 4] __attribute__((section(".task_stacks"), aligned(bytes)))
+
+/* Vùng chia sẻ giữa các task: section .shared (linker.ld), một region MPU nên kích
+   thước là lũy thừa 2 và phải khớp với linker.ld. Task có OS_CAP_SHARED truy cập
+   được (region 7), task khác thì không. Dùng cho dữ liệu mà task unprivileged đọc/ghi
+   trực tiếp: payload của pool/buf queue, hàng đợi SPSC, biến dùng chung.
+   Không nạp từ flash: kernel xóa về 0 lúc boot (mpu_init), không dùng giá trị khởi tạo. */
+#define OS_SHARED_SIZE 4096
+#define OS_SHARED __attribute__((section(".shared")))
+extern uint8_t __shared_start[], __shared_end[]; // linker.ld
+
+/* [p, p + len) nằm trọn trong vùng chia sẻ. Chỉ so địa chỉ, không đọc bộ nhớ:
+   gọi được từ task không có OS_CAP_SHARED */
+static inline int os_is_shared(const void *p, uint32_t len)
+{
+    uint32_t a = (uint32_t)p;
+    return a >= (uint32_t)__shared_start && a <= (uint32_t)__shared_end &&
+           len <= (uint32_t)__shared_end - a;
+}
+
+/* Tham số tạo task, gói lại để đi qua một thanh ghi khi gọi bằng syscall */
+typedef struct {
+    void (*entry)(void);
+    uint32_t pid;
+    uint8_t priority;
+    int *max_res;          // Banker: nhu cầu tối đa (NULL = 0 hết)
+    uint32_t stack_size;   // byte
+    uint32_t *stack;       // NULL: lấy từ vùng stack; khác NULL: stack tĩnh (OS_TASK_STACK)
+    uint32_t heap_size;    // byte heap riêng (MPU region 2, os_task_malloc); 0: không có
+    uint8_t caps;          // OS_CAP_* (mặc định 0: không có quyền riêng)
+} process_create_args_t;
+
+void process_create(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res); // stack STACK_SIZE word
+void process_create_ex(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res,
+                       uint32_t stack_size);
+void process_create_static(void (*func)(void), uint32_t pid, uint8_t priority, int *max_res,
+                           uint32_t *stack, uint32_t stack_size);
+void process_create_args(const process_create_args_t *args);
+
+uint32_t process_stack_used(PCB_t *p); // high-water mark (byte) theo mẫu tô OS_STACK_PAINT
+void process_print_stacks(void);       // lệnh 'stack
 void process_admit_jobs(void);
 void process_schedule(void);
+void process_preempt_check(void);
+uint8_t process_time_quantum(PCB_t *p);
+void process_set_time_slice(uint32_t pid, uint8_t ticks);
+void process_set_priority_time_slice(uint8_t priority, uint8_t ticks);
 void process_set_state(uint32_t pid, process_state_t new_state);
+
+/* Số đếm đổi ngữ cảnh cho benchmark, đọc được từ task unprivileged */
+typedef struct {
+    uint32_t switches;      // context_switch_count
+    uint32_t pendsv_cycles; // context_switch_cycles
+} os_switch_stats_t;
+void process_get_switch_stats(os_switch_stats_t *stats);
+void process_suspend_current(void); // treo task đang chạy vì lỗi (MPU, tham số syscall) và lập lịch lại
 const char* process_state_str(process_state_t state);
 void os_delay(uint32_t tick);
+void os_yield(void);
 void process_timer_tick(void);
+uint32_t process_idle_expected_ticks(void);
+void process_step_tick(uint32_t ticks);
 void add_task_to_ready_queue(PCB_t *p);
+void remove_task_from_ready_queue(PCB_t *p);
+void process_set_dynamic_priority(PCB_t *p, uint8_t priority);
+void process_block_current(uint32_t timeout);
+void process_wake_task(PCB_t *p, os_status_t status);
 PCB_t* get_highest_priority_ready_task(void);
+
+/* Độ ưu tiên cao nhất có task READY (bitmap phải khác 0).
+   CLZ đếm số bit 0 ở đầu -> bit cao nhất = 31 - CLZ, chạy O(1) bất kể MAX_PRIORITY. */
+static inline uint32_t os_highest_priority(uint32_t bitmap)
+{
+    uint32_t leading_zeros;
+    __asm ("clz %0, %1" : "=r" (leading_zeros) : "r" (bitmap));
+    return 31 - leading_zeros;
+}
 void prvIdleTask(void);
+void process_account_switch(PCB_t *next);
+void process_top_begin(void);
+void process_print_top(void);
 #endif
@@ -2,38 +2,77 @@
 #include "process.h"
 
 void queue_init(queue_t *q) {
-    q->front = 0;
-    q->rear = -1;
-    q->count = 0;
+    q->head = NULL;
+    q->tail = NULL;
 }
 
 int queue_is_empty(queue_t *q) {
-    return q->count == 0;
+    return q->head == NULL;
 }
 
-int queue_is_full(queue_t *q) {
-    return q->count == MAX_QUEUE_LEN;
+void queue_enqueue(queue_t *q, struct PCB *pcb) {
+    pcb->qnode.next = NULL;
+    pcb->qnode.prev = q->tail;
+    pcb->qnode.owner = q;
+
+    if (q->tail) {
+        q->tail->qnode.next = pcb;
+    } else {
+        q->head = pcb;
+    }
+    q->tail = pcb;
 }
 
-void queue_enqueue(queue_t *q, struct PCB *pcb) {
-    if (queue_is_full(q)) {
-        OS_EXIT_CRITICAL();
-        return;
+void queue_insert_by_priority(queue_t *q, struct PCB *pcb) {
+    /* Duyệt từ cuối: waiter mới thường không cao hơn các waiter đang chờ */
+    struct PCB *prev = q->tail;
+    while (prev && prev->dynamic_priority < pcb->dynamic_priority) {
+        prev = prev->qnode.prev;
+    }
+
+    pcb->qnode.prev = prev;
+    pcb->qnode.owner = q;
+    if (prev) {
+        pcb->qnode.next = prev->qnode.next;
+        prev->qnode.next = pcb;
+    } else {
+        pcb->qnode.next = q->head;
+        q->head = pcb;
+    }
+    if (pcb->qnode.next) {
+        pcb->qnode.next->qnode.prev = pcb;
+    } else {
+        q->tail = pcb;
     }
-    q->rear = (q->rear + 1) % MAX_QUEUE_LEN;
-    q->items[q->rear] = pcb;
-    q->count++;
 }
 
 struct PCB* queue_dequeue(queue_t *q) {
-    OS_ENTER_CRITICAL();
-    if (queue_is_empty(q)) {
-        OS_EXIT_CRITICAL();
-        return 0;
-    }
-    struct PCB *pcb = q->items[q->front];
-    q->front = (q->front + 1) % MAX_QUEUE_LEN;
-    q->count--;
-    OS_EXIT_CRITICAL();
+    struct PCB *pcb = q->head;
+    if (pcb == NULL) {
+        return NULL;
+    }
+    queue_remove(pcb);
     return pcb;
 }
+
+void queue_remove(struct PCB *pcb) {
+    queue_t *q = pcb->qnode.owner;
+    if (q == NULL) {
+        return;
+    }
+
+    if (pcb->qnode.prev) {
+        pcb->qnode.prev->qnode.next = pcb->qnode.next;
+    } else {
+        q->head = pcb->qnode.next;
+    }
+    if (pcb->qnode.next) {
+        pcb->qnode.next->qnode.prev = pcb->qnode.prev;
+    } else {
+        q->tail = pcb->qnode.prev;
+    }
+
+    pcb->qnode.next = NULL;
+    pcb->qnode.prev = NULL;
+    pcb->qnode.owner = NULL;
+}
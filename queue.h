@@ -5,20 +5,29 @@
 #include <stddef.h>
 
 struct PCB;
-#define MAX_QUEUE_LEN 10 
+struct queue;
 
-typedef struct {
-    struct PCB* items[MAX_QUEUE_LEN];
-    int front;
-    int rear;
-    int count;
+/* Nút liên kết nhúng sẵn trong PCB (intrusive list).
+   Một task chỉ nằm trên tối đa 1 hàng đợi tại một thời điểm (ready hoặc wait list),
+   nên thêm/lấy/xóa đều O(1), không giới hạn số phần tử và không tốn bộ nhớ theo từng task. */
+typedef struct queue_node {
+    struct PCB *next;
+    struct PCB *prev;
+    struct queue *owner;   // Hàng đợi đang chứa task (NULL: không nằm trong hàng đợi nào)
+} queue_node_t;
+
+typedef struct queue {
+    struct PCB *head;
+    struct PCB *tail;
 } queue_t;
 
 // Hàm hàng đợi cơ bản
+// LƯU Ý: không tự tắt ngắt, người gọi phải giữ OS_ENTER_CRITICAL()
 void queue_init(queue_t *q);
 int queue_is_empty(queue_t *q);
-int queue_is_full(queue_t *q);
 void queue_enqueue(queue_t *q, struct PCB *pcb);
+void queue_insert_by_priority(queue_t *q, struct PCB *pcb); // Sắp theo dynamic_priority giảm dần, FIFO khi bằng nhau
 struct PCB* queue_dequeue(queue_t *q);
+void queue_remove(struct PCB *pcb); // Gỡ task khỏi hàng đợi đang chứa nó (nếu có)
 
 #endif
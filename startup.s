@@ -19,6 +19,7 @@
 
 .extern main  // nói với assembly rằng hàm main() được định nghĩa ở C, rết handler sẽ gọi bl main
 .extern PendSV_Handler
+.extern SVC_Handler
 .extern SysTick_Handler
 .extern start_first_task // hàm khởi tạo task đầu tiên trong hệ điều hành thời gian thực
 
@@ -32,19 +33,19 @@ vector_table:
     .word _estack // entry0: giá trị này dùng để nạp vào main stack pointer cpu đọc entry này ngay sau reset
     .word Reset_Handler  // entry1: địa chỉ của hàm reset handler CPU nhảy tới đây sau khi thiết lập MSP
     .word Default_Handler    /* NMI */
-    .word Default_Handler    /* HardFault */
+    .word HardFault_Handler  /* HardFault */
     .word MemManage_Handler  /* MemManage */
     .word Default_Handler    /* BusFault */
     .word Default_Handler    /* UsageFault */
     .word 0,0,0,0            /* Reserved */
-    .word Default_Handler    /* SVC */
+    .word SVC_Handler        /* SVC */
     .word Default_Handler    /* DebugMon */
     .word 0                  /* Reserved */
     .word PendSV_Handler     /* PendSV */ // dùng cho context switch
     .word SysTick_Handler    /* SysTick */ //timer tick của cortex - M3
 
-    .word Default_Handler /* IRQ0 : GPIO port A */
-    .word Default_Handler /* IRQ1 : GPIO port B */
+    .word GPIOPortA_Handler /* IRQ0 : GPIO port A */
+    .word GPIOPortB_Handler /* IRQ1 : GPIO port B */
     .word Default_Handler /* IRQ2 : GPIO port C */
     .word Default_Handler /* IRQ3 : GPIO port D */
     .word Default_Handler /* IRQ4 : GPIO port E */
@@ -57,8 +58,14 @@ vector_table:
 /* ========================================
    PHẦN 3: RESET HANDLER : copy data từ flash sang ram , xóa vùng bss và gọi main
    ======================================== */
+.weak HardFault_Handler
+.thumb_set HardFault_Handler, Default_Handler
 .weak MemManage_Handler
 .thumb_set MemManage_Handler, Default_Handler
+.weak GPIOPortA_Handler
+.thumb_set GPIOPortA_Handler, Default_Handler
+.weak GPIOPortB_Handler
+.thumb_set GPIOPortB_Handler, Default_Handler
 
 .section .text.Reset_Handler
 .weak Reset_Handler
@@ -0,0 +1,437 @@
+#include "svc.h"
+#include "process.h"
+#include "sync.h"
+#include "ipc.h"
+#include "memory.h"
+#include "banker.h"
+#include "uart.h"
+#include "systick.h"
+#include "critprof.h"
+#include "pool.h"
+#include "dwt.h"
+#include "mpu.h"
+
+#define SCB_SHPR2   (*(volatile uint32_t*)0xE000ED1C) // ưu tiên SVCall [31:24]
+#define SCB_AIRCR   (*(volatile uint32_t*)0xE000ED0C)
+
+/* Khung stack phần cứng tự cất khi vào exception */
+#define FRAME_R0    0
+#define FRAME_R1    1
+#define FRAME_R2    2
+#define FRAME_R3    3
+#define FRAME_LR    5
+#define FRAME_PC    6
+#define FRAME_XPSR  7
+
+#define XPSR_T_BIT      (1UL << 24)
+#define XPSR_ALIGN_BIT  (1UL << 9)  // phần cứng đã chèn 1 word đệm để căn stack: phải giữ nguyên
+
+#define SVC_NAME_MAX    32          // tên pool (os_pool_create): tính cả '\0'
+
+typedef uint32_t (*svc_fn_t)(uint32_t, uint32_t, uint32_t, uint32_t);
+
+#define SVC_ENTRY(fn) ((svc_fn_t)(void (*)(void))(fn))
+
+extern void svc_exit_stub(void); // context_switch.s: "svc #SYS_EXIT"
+
+static uint32_t svc_null(void)
+{
+    return 0;
+}
+
+/* ============================================================
+   KIỂM TRA THAM SỐ
+   Hàm kernel chạy privileged, PRIVDEFENA cho nó truy cập mọi địa chỉ nên MPU
+   không chặn hộ: con trỏ task truyền vào phải được kiểm tra trước khi kernel
+   đọc/ghi qua nó.
+   - Kernel object: khai báo bằng OS_KERNEL_OBJECT(kiểu), trỏ đúng một phần tử.
+   - PCB: một phần tử đã được tạo của pcb_table.
+   - Vùng dữ liệu: nằm trong region của chính task (mpu_task_can_access).
+   Sai thì task bị treo như khi MPU fault.
+   ============================================================ */
+#define SVC_KOBJ_BOUNDS(type) extern type __kobj_##type##_start[], __kobj_##type##_end[]
+SVC_KOBJ_BOUNDS(os_sem_t);
+SVC_KOBJ_BOUNDS(os_mutex_t);
+SVC_KOBJ_BOUNDS(os_msg_queue_t);
+SVC_KOBJ_BOUNDS(os_buf_queue_t);
+SVC_KOBJ_BOUNDS(os_pool_t);
+
+extern uint32_t __task_stacks_start[], __task_stacks_end[]; // linker.ld
+
+#define svc_kobj_ok(type, p) \
+    svc_in_array((p), (uint32_t)__kobj_##type##_start, (uint32_t)__kobj_##type##_end, sizeof(type))
+
+static inline int svc_in_array(uint32_t p, uint32_t start, uint32_t end, uint32_t stride)
+{
+    return p >= start && p < end && (p - start) % stride == 0;
+}
+
+static inline int svc_pcb_ok(uint32_t p)
+{
+    return svc_in_array(p, (uint32_t)pcb_table, (uint32_t)&pcb_table[MAX_PROCESSES], sizeof(PCB_t)) &&
+           ((PCB_t *)p)->entry != NULL;
+}
+
+static inline int svc_user_ok(uint32_t addr, uint32_t len, int write)
+{
+    return mpu_task_can_access(current_pcb, (const void *)addr, len, write);
+}
+
+/* Tên pool được giữ lại và in về sau: chỉ nhận NULL hoặc chuỗi hằng trong flash */
+static int svc_name_ok(uint32_t name)
+{
+    if (name == 0) {
+        return 1;
+    }
+    for (uint32_t i = 0; i < SVC_NAME_MAX; i++) {
+        if (name + i - MPU_FLASH_BASE >= MPU_FLASH_SIZE) {
+            return 0;
+        }
+        if (*(const char *)(name + i) == '\0') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Stack tĩnh của task con: phải là một OS_TASK_STACK và chưa task nào dùng */
+static int svc_static_stack_ok(const uint32_t *stack, uint32_t size)
+{
+    uint32_t base = (uint32_t)stack;
+    uint32_t start = (uint32_t)__task_stacks_start;
+    uint32_t end = (uint32_t)__task_stacks_end;
+
+    if (base < start || size > end - start || base - start > end - start - size) {
+        return 0;
+    }
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        PCB_t *p = &pcb_table[i];
+        if (p->entry != NULL && base < p->stack_base + p->stack_size && p->stack_base < base + size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void svc_reject(uint32_t number)
+{
+    uart_print("\r\n*** SVC: bad argument to syscall ");
+    uart_print_dec(number);
+    uart_print(" ***\r\n");
+    process_suspend_current();
+}
+
+/* Tham số của các syscall gọi thẳng qua bảng; syscall có wrapper riêng
+   (svc_free, svc_msg_*_many, svc_process_create) tự kiểm tra */
+static int svc_args_ok(uint32_t number, const uint32_t *frame)
+{
+    uint32_t a0 = frame[FRAME_R0];
+    uint32_t a1 = frame[FRAME_R1];
+    uint32_t a2 = frame[FRAME_R2];
+    uint32_t a3 = frame[FRAME_R3];
+
+    switch (number) {
+    case SYS_SEM_INIT: // init lại khi còn task chờ sẽ làm hỏng wait list
+        return (current_pcb->caps & OS_CAP_SYNC_INIT) && svc_kobj_ok(os_sem_t, a0) &&
+               queue_is_empty(&((os_sem_t *)a0)->wait_list);
+    case SYS_SEM_SIGNAL:
+    case SYS_SEM_TRY_WAIT:
+    case SYS_SEM_TRY_WAIT_MANY:
+    case SYS_SEM_SIGNAL_MANY:
+    case SYS_SEM_WAIT:
+        return svc_kobj_ok(os_sem_t, a0);
+    case SYS_MUTEX_INIT:
+        return (current_pcb->caps & OS_CAP_SYNC_INIT) && svc_kobj_ok(os_mutex_t, a0) && !((os_mutex_t *)a0)->locked &&
+               queue_is_empty(&((os_mutex_t *)a0)->wait_list);
+    case SYS_MUTEX_TRY_LOCK:
+    case SYS_MUTEX_UNLOCK:
+    case SYS_MUTEX_LOCK:
+        return svc_kobj_ok(os_mutex_t, a0);
+    case SYS_NOTIFY_GIVE:
+        return svc_pcb_ok(a0);
+    case SYS_NOTIFY_TRY_WAIT:
+    case SYS_NOTIFY_WAIT:
+        return a1 == 0 || svc_user_ok(a1, sizeof(uint32_t), 1);
+    case SYS_REQUEST_RES:
+    case SYS_RELEASE_RES:
+        return svc_user_ok(a0, NUM_RESOURCES * sizeof(int), 0);
+    case SYS_REBOOT:
+        return (current_pcb->caps & OS_CAP_REBOOT) != 0;
+    case SYS_SET_TIME_SLICE: // time slice của chính mình thì không cần quyền
+        return a0 == current_pcb->pid || (current_pcb->caps & OS_CAP_SCHED) != 0;
+    case SYS_SET_PRIO_TIME_SLICE:
+        return (current_pcb->caps & OS_CAP_SCHED) != 0;
+    case SYS_POOL_CREATE: // tạo lại pool đang có block được cấp sẽ làm mất các block đó
+        return svc_kobj_ok(os_pool_t, a0) && ((os_pool_t *)a0)->block_count == 0 && svc_name_ok(a1) &&
+               os_pool_size_ok(a2, a3);
+    case SYS_POOL_ALLOC:
+    case SYS_POOL_FREE:
+        return svc_kobj_ok(os_pool_t, a0);
+    case SYS_HEAP_STATS:
+        return svc_user_ok(a0, sizeof(os_heap_stats_t), 1);
+    case SYS_SWITCH_STATS:
+        return svc_user_ok(a0, sizeof(os_switch_stats_t), 1);
+    case SYS_BUFQ_ALLOC:
+    case SYS_BUFQ_CAPACITY:
+    case SYS_BUFQ_RELEASE:
+        return svc_kobj_ok(os_buf_queue_t, a0);
+    case SYS_BUFQ_SEND:
+        return svc_kobj_ok(os_buf_queue_t, a0) && os_pool_contains(((os_buf_queue_t *)a0)->pool, (void *)a1);
+    case SYS_BUFQ_RECEIVE:
+        return svc_kobj_ok(os_buf_queue_t, a0) && svc_user_ok(a1, sizeof(void *), 1) &&
+               (a2 == 0 || svc_user_ok(a2, sizeof(uint32_t), 1));
+    case SYS_MSG_INIT_SPSC: // vị trí của q (OS_SHARED) do msg_queue_init_spsc kiểm tra
+        return svc_user_ok(a0, sizeof(os_msg_queue_t), 1) && svc_pcb_ok(a1) && svc_pcb_ok(a2);
+    case SYS_MSG_SEND:
+    case SYS_MSG_SEND_MANY:
+    case SYS_MSG_RECEIVE_MANY:
+        return svc_kobj_ok(os_msg_queue_t, a0);
+    case SYS_MSG_RECEIVE:
+        return svc_kobj_ok(os_msg_queue_t, a0) && svc_user_ok(a1, sizeof(int32_t), 1);
+    default:
+        return 1;
+    }
+}
+
+/* Dạng try: luôn OS_NO_WAIT, không dùng timeout task đưa vào (fast path không được chặn) */
+static os_status_t svc_notify_try_wait(uint32_t clear_bits_on_exit, uint32_t *value)
+{
+    return notify_wait(clear_bits_on_exit, value, OS_NO_WAIT);
+}
+
+static void svc_free(void *ptr)
+{
+    if (ptr == NULL) {
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    int owned = os_heap_block_owned(ptr, current_pcb->pid + 1);
+    if (owned) {
+        os_free(ptr);
+    }
+    OS_EXIT_CRITICAL();
+
+    if (!owned) {
+        svc_reject(SYS_FREE);
+    }
+}
+
+/* Thread path: chép os_msg_batch_t vào stack kernel rồi mới kiểm tra mảng data,
+   để task không đổi được data/count giữa lúc kiểm tra và lúc kernel dùng */
+static os_status_t svc_msg_transfer_many(os_msg_queue_t *q, os_msg_batch_t *user_batch,
+                                         uint32_t timeout, uint32_t number)
+{
+    int receive = (number == SYS_MSG_RECEIVE_MANY);
+    os_msg_batch_t batch;
+
+    if (!svc_user_ok((uint32_t)user_batch, sizeof(batch), 1)) {
+        svc_reject(number);
+        return OS_ERR_WOULD_BLOCK;
+    }
+    batch = *user_batch;
+    if (batch.count > 0 &&
+        (batch.count > UINT32_MAX / sizeof(int32_t) ||
+         !svc_user_ok((uint32_t)batch.data, batch.count * sizeof(int32_t), receive))) {
+        svc_reject(number);
+        return OS_ERR_WOULD_BLOCK;
+    }
+
+    os_status_t status = receive ? msg_queue_receive_many(q, &batch, timeout)
+                                 : msg_queue_send_many(q, &batch, timeout);
+    user_batch->count = batch.count;
+    return status;
+}
+
+static os_status_t svc_msg_send_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout)
+{
+    return svc_msg_transfer_many(q, batch, timeout, SYS_MSG_SEND_MANY);
+}
+
+static os_status_t svc_msg_receive_many(os_msg_queue_t *q, os_msg_batch_t *batch, uint32_t timeout)
+{
+    return svc_msg_transfer_many(q, batch, timeout, SYS_MSG_RECEIVE_MANY);
+}
+
+/* Thread path, cũng chép tham số trước khi kiểm tra. Task không được ghi đè PID
+   đang dùng, không cấp cho task con quyền mà chính nó không có. */
+static void svc_process_create(const process_create_args_t *user_args)
+{
+    PCB_t *caller = current_pcb;
+    process_create_args_t args;
+
+    if (!svc_user_ok((uint32_t)user_args, sizeof(args), 0)) {
+        svc_reject(SYS_PROCESS_CREATE);
+        return;
+    }
+    args = *user_args;
+
+    if (args.pid >= MAX_PROCESSES || pcb_table[args.pid].entry != NULL ||
+        !svc_user_ok((uint32_t)args.entry, sizeof(uint16_t), 0) ||
+        (args.max_res != NULL && !svc_user_ok((uint32_t)args.max_res, NUM_RESOURCES * sizeof(int), 0)) ||
+        (args.stack != NULL && !svc_static_stack_ok(args.stack, args.stack_size)) ||
+        (args.caps & ~caller->caps) != 0) {
+        svc_reject(SYS_PROCESS_CREATE);
+        return;
+    }
+    process_create_args(&args);
+}
+
+/* Đa số API là void hoặc trả về giá trị trong r0: gọi thẳng qua bảng.
+   Số tham số đúng bằng số thanh ghi r0-r3 được dùng, phần còn lại bị bỏ qua (AAPCS).
+   Tham số được svc_args_ok() hoặc wrapper svc_* kiểm tra trước. */
+static const svc_fn_t svc_table[SYS_COUNT] = {
+    [SYS_NULL]                = SVC_ENTRY(svc_null),
+    [SYS_GET_CYCLES]          = SVC_ENTRY(os_get_cycles),
+    [SYS_GET_TICKS]           = SVC_ENTRY(os_get_ticks),
+    [SYS_YIELD]               = SVC_ENTRY(os_yield),
+    [SYS_SEM_INIT]            = SVC_ENTRY(sem_init),
+    [SYS_SEM_SIGNAL]          = SVC_ENTRY(sem_signal),
+    [SYS_SEM_TRY_WAIT]        = SVC_ENTRY(sem_try_wait),
+    [SYS_SEM_TRY_WAIT_MANY]   = SVC_ENTRY(sem_try_wait_many),
+    [SYS_SEM_SIGNAL_MANY]     = SVC_ENTRY(sem_signal_many),
+    [SYS_MUTEX_INIT]          = SVC_ENTRY(mutex_init_protocol),
+    [SYS_MUTEX_TRY_LOCK]      = SVC_ENTRY(mutex_try_lock),
+    [SYS_MUTEX_UNLOCK]        = SVC_ENTRY(mutex_unlock),
+    [SYS_NOTIFY_GIVE]         = SVC_ENTRY(notify_give),
+    [SYS_NOTIFY_TRY_WAIT]     = SVC_ENTRY(svc_notify_try_wait),
+    [SYS_MALLOC]              = SVC_ENTRY(os_malloc_aligned),
+    [SYS_FREE]                = SVC_ENTRY(svc_free),
+    [SYS_REQUEST_RES]         = SVC_ENTRY(request_resources),
+    [SYS_RELEASE_RES]         = SVC_ENTRY(release_resources),
+    [SYS_SET_TIME_SLICE]      = SVC_ENTRY(process_set_time_slice),
+    [SYS_SET_PRIO_TIME_SLICE] = SVC_ENTRY(process_set_priority_time_slice),
+    [SYS_TOP_BEGIN]           = SVC_ENTRY(process_top_begin),
+    [SYS_IRQOFF_RESET]        = SVC_ENTRY(crit_profile_reset),
+    [SYS_REBOOT]              = SVC_ENTRY(os_reboot),
+    [SYS_POOL_CREATE]         = SVC_ENTRY(os_pool_create),
+    [SYS_POOL_ALLOC]          = SVC_ENTRY(os_pool_alloc),
+    [SYS_POOL_FREE]           = SVC_ENTRY(os_pool_free),
+    [SYS_HEAP_FREE]           = SVC_ENTRY(os_get_free_heap_size),
+    [SYS_HEAP_STATS]          = SVC_ENTRY(os_heap_get_stats),
+    [SYS_SWITCH_STATS]        = SVC_ENTRY(process_get_switch_stats),
+    [SYS_TASK_MALLOC]         = SVC_ENTRY(os_task_malloc),
+    [SYS_TASK_FREE]           = SVC_ENTRY(os_task_free),
+    [SYS_BUFQ_ALLOC]          = SVC_ENTRY(buf_queue_alloc),
+    [SYS_BUFQ_CAPACITY]       = SVC_ENTRY(buf_queue_capacity),
+    [SYS_BUFQ_RELEASE]        = SVC_ENTRY(buf_queue_release),
+    [SYS_MSG_INIT_SPSC]       = SVC_ENTRY(msg_queue_init_spsc),
+
+    [SYS_DELAY]               = SVC_ENTRY(os_delay),
+    [SYS_SEM_WAIT]            = SVC_ENTRY(sem_wait_timeout),
+    [SYS_MUTEX_LOCK]          = SVC_ENTRY(mutex_lock_timeout),
+    [SYS_NOTIFY_WAIT]         = SVC_ENTRY(notify_wait),
+    [SYS_MSG_SEND]            = SVC_ENTRY(msg_queue_send_timeout),
+    [SYS_MSG_RECEIVE]         = SVC_ENTRY(msg_queue_receive_timeout),
+    [SYS_MSG_SEND_MANY]       = SVC_ENTRY(svc_msg_send_many),
+    [SYS_MSG_RECEIVE_MANY]    = SVC_ENTRY(svc_msg_receive_many),
+    [SYS_BUFQ_SEND]           = SVC_ENTRY(buf_queue_send),
+    [SYS_BUFQ_RECEIVE]        = SVC_ENTRY(buf_queue_receive),
+    [SYS_PROCESS_CREATE]      = SVC_ENTRY(svc_process_create),
+    [SYS_UART_GETC]           = SVC_ENTRY(uart_getc),
+    [SYS_IDLE]                = SVC_ENTRY(systick_tickless_idle),
+    [SYS_TOP_PRINT]           = SVC_ENTRY(process_print_top),
+    [SYS_IRQOFF_DUMP]         = SVC_ENTRY(crit_profile_dump),
+    [SYS_STACK_PRINT]         = SVC_ENTRY(process_print_stacks),
+    [SYS_POOL_PRINT]          = SVC_ENTRY(os_pool_print),
+    [SYS_HEAP_PRINT]          = SVC_ENTRY(os_heap_print),
+};
+
+/* Ghi CONTROL.nPRIV cho Thread mode (gọi từ handler mode, có hiệu lực khi exception return) */
+static inline void svc_set_thread_unprivileged(uint32_t unprivileged)
+{
+    uint32_t control;
+    __asm volatile ("mrs %0, control" : "=r" (control));
+    control = (control & ~1UL) | unprivileged;
+    __asm volatile ("msr control, %0\n"
+                    "isb" : : "r" (control) : "memory");
+}
+
+void svc_init(void)
+{
+    // SVC cùng mức với PendSV/SysTick: không chen ngang nhau, ISR của ngoại vi vẫn vào được
+    SCB_SHPR2 = (SCB_SHPR2 & 0x00FFFFFFUL) | ((uint32_t)OS_KERNEL_INTERRUPT_PRIORITY << 24);
+}
+
+/* Thread path, bước 1: sửa khung stack để exception return "nhảy" vào hàm kernel
+   ở privileged Thread mode, khi hàm return thì rơi vào svc_exit_stub */
+static void svc_enter_thread(uint32_t *frame, svc_fn_t fn)
+{
+    PCB_t *p = current_pcb;
+
+    p->svc_return_pc = frame[FRAME_PC];
+    p->svc_return_lr = frame[FRAME_LR];
+    p->in_syscall = 1;
+
+    frame[FRAME_LR]   = (uint32_t)svc_exit_stub;
+    frame[FRAME_PC]   = (uint32_t)fn & ~1UL;
+    frame[FRAME_XPSR] = (frame[FRAME_XPSR] & XPSR_ALIGN_BIT) | XPSR_T_BIT;
+    svc_set_thread_unprivileged(0);
+}
+
+/* Thread path, bước 2 (SYS_EXIT): r0 trong khung đã là kết quả, trả PC/LR gốc và hạ quyền */
+static void svc_exit_thread(uint32_t *frame)
+{
+    PCB_t *p = current_pcb;
+
+    if (p == NULL || !p->in_syscall) {
+        return; // Không phải do svc_exit_stub gọi: bỏ qua
+    }
+    p->in_syscall = 0;
+
+    frame[FRAME_LR]   = p->svc_return_lr;
+    frame[FRAME_PC]   = p->svc_return_pc;
+    frame[FRAME_XPSR] = (frame[FRAME_XPSR] & XPSR_ALIGN_BIT) | XPSR_T_BIT;
+    svc_set_thread_unprivileged(1);
+}
+
+void svc_dispatch(uint32_t *frame, uint32_t number)
+{
+    if (number == SYS_EXIT) {
+        svc_exit_thread(frame);
+        return;
+    }
+    if (number >= SYS_COUNT || svc_table[number] == NULL) {
+        frame[FRAME_R0] = 0; // Số hiệu không hợp lệ
+        return;
+    }
+
+    if (!svc_args_ok(number, frame)) {
+        frame[FRAME_R0] = 0;
+        svc_reject(number);
+        return;
+    }
+
+    if (number < SYS_THREAD_FIRST) {
+        frame[FRAME_R0] = svc_table[number](frame[FRAME_R0], frame[FRAME_R1],
+                                            frame[FRAME_R2], frame[FRAME_R3]);
+        return;
+    }
+
+    svc_enter_thread(frame, svc_table[number]);
+}
+
+uint32_t os_get_cycles(void)
+{
+    if (!os_is_privileged()) {
+        return os_syscall0(SYS_GET_CYCLES);
+    }
+    return dwt_get_cycles();
+}
+
+uint32_t os_get_ticks(void)
+{
+    if (!os_is_privileged()) {
+        return os_syscall0(SYS_GET_TICKS);
+    }
+    return tick_count;
+}
+
+void os_reboot(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_REBOOT);
+        return;
+    }
+    // Reset bằng cách ghi vào AIRCR của SCB
+    SCB_AIRCR = 0x05FA0004;
+}
@@ -0,0 +1,108 @@
+#ifndef SVC_H
+#define SVC_H
+
+#include <stdint.h>
+
+/* Bảng số hiệu system call (immediate của lệnh svc).
+   - Fast path (< SYS_THREAD_FIRST): chạy ngay trong SVC_Handler, không bao giờ chặn.
+   - Thread path (>= SYS_THREAD_FIRST): có thể chặn -> SVC_Handler chuyển task sang
+     privileged Thread mode, chạy hàm kernel trên stack của task, xong thì
+     svc_exit_stub gọi SYS_EXIT để hạ quyền và quay về chỗ gọi. */
+typedef enum {
+    SYS_EXIT = 0,           // Nội bộ: kết thúc thread path (context_switch.s dùng "svc #0")
+
+    /* --- Fast path --- */
+    SYS_NULL,               // Không làm gì: đo chi phí một lần svc
+    SYS_GET_CYCLES,
+    SYS_GET_TICKS,
+    SYS_YIELD,
+    SYS_SEM_INIT,
+    SYS_SEM_SIGNAL,
+    SYS_SEM_TRY_WAIT,
+    SYS_SEM_TRY_WAIT_MANY,
+    SYS_SEM_SIGNAL_MANY,
+    SYS_MUTEX_INIT,
+    SYS_MUTEX_TRY_LOCK,
+    SYS_MUTEX_UNLOCK,
+    SYS_NOTIFY_GIVE,
+    SYS_NOTIFY_TRY_WAIT,
+    SYS_MALLOC,
+    SYS_FREE,
+    SYS_REQUEST_RES,
+    SYS_RELEASE_RES,
+    SYS_SET_TIME_SLICE,
+    SYS_SET_PRIO_TIME_SLICE,
+    SYS_TOP_BEGIN,
+    SYS_IRQOFF_RESET,
+    SYS_REBOOT,
+    SYS_POOL_CREATE,
+    SYS_POOL_ALLOC,
+    SYS_POOL_FREE,
+    SYS_HEAP_FREE,
+    SYS_HEAP_STATS,
+    SYS_SWITCH_STATS,
+    SYS_TASK_MALLOC,
+    SYS_TASK_FREE,
+    SYS_BUFQ_ALLOC,
+    SYS_BUFQ_CAPACITY,
+    SYS_BUFQ_RELEASE,
+    SYS_MSG_INIT_SPSC,
+
+    /* --- Thread path --- */
+    SYS_THREAD_FIRST,
+    SYS_DELAY = SYS_THREAD_FIRST,
+    SYS_SEM_WAIT,
+    SYS_MUTEX_LOCK,
+    SYS_NOTIFY_WAIT,
+    SYS_MSG_SEND,
+    SYS_MSG_RECEIVE,
+    SYS_MSG_SEND_MANY,
+    SYS_MSG_RECEIVE_MANY,
+    SYS_BUFQ_SEND,
+    SYS_BUFQ_RECEIVE,
+    SYS_PROCESS_CREATE,
+    SYS_UART_GETC,
+    SYS_IDLE,
+    SYS_TOP_PRINT,
+    SYS_IRQOFF_DUMP,
+    SYS_STACK_PRINT,
+    SYS_POOL_PRINT,
+    SYS_HEAP_PRINT,
+
+    SYS_COUNT
+} os_syscall_t;
+
+/* Gọi system call: tham số trong r0-r3, kết quả trả về trong r0.
+   Thread path chạy hàm C thật nên r1-r3, r12 có thể bị thay đổi. */
+#define os_syscall4(num, a0, a1, a2, a3) ({                                 \
+        register uint32_t _r0 __asm("r0") = (uint32_t)(a0);                 \
+        register uint32_t _r1 __asm("r1") = (uint32_t)(a1);                 \
+        register uint32_t _r2 __asm("r2") = (uint32_t)(a2);                 \
+        register uint32_t _r3 __asm("r3") = (uint32_t)(a3);                 \
+        __asm volatile ("svc %[n]"                                          \
+                        : "+r" (_r0), "+r" (_r1), "+r" (_r2), "+r" (_r3)    \
+                        : [n] "I" (num)                                     \
+                        : "r12", "memory");                                 \
+        _r0; })
+
+#define os_syscall0(num)              os_syscall4(num, 0, 0, 0, 0)
+#define os_syscall1(num, a0)          os_syscall4(num, a0, 0, 0, 0)
+#define os_syscall2(num, a0, a1)      os_syscall4(num, a0, a1, 0, 0)
+#define os_syscall3(num, a0, a1, a2)  os_syscall4(num, a0, a1, a2, 0)
+
+/* Kernel object mà task unprivileged dùng qua syscall (os_sem_t, os_mutex_t,
+   os_msg_queue_t, os_buf_queue_t, os_pool_t) phải khai báo kèm macro này:
+       os_sem_t data_ready OS_KERNEL_OBJECT(os_sem_t);
+   linker.ld gom mỗi kiểu thành một mảng liên tục trong .bss, svc_dispatch chỉ
+   nhận con trỏ trỏ đúng đầu một phần tử của mảng đó. */
+#define OS_KERNEL_OBJECT(type) __attribute__((section(".bss.kobj." #type)))
+
+void svc_init(void);
+void svc_dispatch(uint32_t *frame, uint32_t number); // gọi từ SVC_Handler (context_switch.s)
+
+/* Dịch vụ nhỏ không thuộc module nào */
+uint32_t os_get_cycles(void);   // DWT CYCCNT, đọc được từ task unprivileged
+uint32_t os_get_ticks(void);    // tick_count, đọc được từ task unprivileged
+void os_reboot(void);
+
+#endif
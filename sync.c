@@ -5,102 +5,440 @@
    ============================================================ */
 // hàm khởi tạo sem
 void sem_init(os_sem_t* sem, int32_t initial_count){
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_SEM_INIT, sem, initial_count);
+        return;
+    }
+    if (!queue_is_empty(&sem->wait_list)) {
+        return; // còn task chờ: init lại sẽ bỏ rơi chúng ngoài mọi hàng đợi
+    }
     sem->count = initial_count;
     queue_init(&sem->wait_list);
 }
 
 // Hàm đưa task hiện tại vào danh sách chờ và gọi Scheduler
-static void block_current_task(queue_t *wait_queue) {
+// Gọi khi ĐANG giữ OS_ENTER_CRITICAL(): kiểm tra điều kiện và vào wait list
+// trong cùng một vùng tới hạn nên không bị mất tín hiệu đánh thức.
+// Wait list sắp theo ưu tiên: task ưu tiên cao nhất luôn ở đầu.
+// Trả về OS_OK nếu được trao tài nguyên, OS_ERR_TIMEOUT nếu hết hạn chờ.
+static os_status_t block_current_task(queue_t *wait_queue, uint32_t timeout) {
     // Logic này giống hệt nhau ở cả Mutex và Semaphore!
-    OS_ENTER_CRITICAL();
-    
-    current_pcb->state = PROC_BLOCKED;
-    queue_enqueue(wait_queue, current_pcb);
+    queue_insert_by_priority(wait_queue, current_pcb);
+    process_block_current(timeout);
     
     OS_EXIT_CRITICAL();
     
     process_schedule(); // Chuyển sang task khác
+    return (os_status_t)current_pcb->wait_status;
 }
 
-// Hàm đánh thức task đang chờ
-static void wake_up_waiting_task(queue_t *wait_queue) {
-    OS_ENTER_CRITICAL();
-    if (!queue_is_empty(wait_queue)) {
-        PCB_t *t = queue_dequeue(wait_queue);
-        t->state = PROC_READY;
-        
-        // SỬA: Thay queue_enqueue bằng hàm thêm vào hàng đợi ưu tiên
-        add_task_to_ready_queue(t); 
-        
-        /* TÙY CHỌN: Preemption (Ngắt quãng)
-           Nếu task vừa được đánh thức có độ ưu tiên cao hơn task đang chạy,
-           ta nên kích hoạt Scheduler ngay lập tức để nó chiếm quyền CPU.
-        */
-        if (current_pcb && t->dynamic_priority > current_pcb->dynamic_priority) {
-             *(volatile uint32_t*)0xE000ED04 |= (1UL << 28); // Trigger PendSV
-        }
+#if !OS_SYNC_HANDOFF
+// Timeout còn lại cho lần chờ lại sau khi thua lúc tranh tài nguyên
+static uint32_t retry_remaining(uint32_t start, uint32_t timeout) {
+    if (timeout == OS_WAIT_FOREVER) {
+        return OS_WAIT_FOREVER;
     }
-    OS_EXIT_CRITICAL();
+    uint32_t elapsed = tick_count - start;
+    return (elapsed < timeout) ? timeout - elapsed : OS_NO_WAIT;
+}
+#endif
+
+// Hàm đánh thức task ưu tiên cao nhất đang chờ. Gọi khi đã tắt ngắt.
+static PCB_t* wake_up_waiting_task(queue_t *wait_queue) {
+    PCB_t *t = wait_queue->head;
+    if (t != NULL) {
+        // Gỡ khỏi cả wait list lẫn danh sách ngủ (nếu đang chờ có timeout)
+        process_wake_task(t, OS_OK);
+    }
+    return t;
 }
 
 /* ============================================================
    PHẦN SEMAPHORE
    ============================================================ */
-void sem_wait(os_sem_t *sem) {
-    while (1) { // Vòng lặp để kiểm tra lại sau khi thức dậy
+#if !OS_SYNC_HANDOFF
+// Bản cũ: thức dậy rồi kiểm tra lại count. Gọi khi đang giữ OS_ENTER_CRITICAL().
+static os_status_t sem_wait_retry(os_sem_t *sem, uint32_t timeout) {
+    uint32_t start = tick_count;
+    uint32_t remaining = timeout;
+
+    while (1) {
+        os_status_t status = block_current_task(&sem->wait_list, remaining);
+        if (status != OS_OK) {
+            return status;
+        }
         OS_ENTER_CRITICAL();
         if (sem->count > 0) {
             sem->count--;
             OS_EXIT_CRITICAL();
-            return; // Lấy được rồi, thoát
+            return OS_OK;
         }
+        remaining = retry_remaining(start, timeout);
+        if (remaining == OS_NO_WAIT) {
+            OS_EXIT_CRITICAL();
+            return OS_ERR_TIMEOUT;
+        }
+    }
+}
+#endif
+
+os_status_t sem_wait_timeout(os_sem_t *sem, uint32_t timeout) {
+    if (!os_is_privileged()) {
+        // Không chờ thì không bao giờ chặn -> fast path
+        if (timeout == OS_NO_WAIT) {
+            return (os_status_t)os_syscall1(SYS_SEM_TRY_WAIT, sem);
+        }
+        return (os_status_t)os_syscall2(SYS_SEM_WAIT, sem, timeout);
+    }
+    OS_ENTER_CRITICAL();
+    if (sem->count > 0) {
+        sem->count--;
         OS_EXIT_CRITICAL();
-        
-        // Nếu chưa có, đi ngủ
-        block_current_task(&sem->wait_list);
+        return OS_OK; // Lấy được rồi, thoát
     }
+    if (timeout == OS_NO_WAIT) {
+        OS_EXIT_CRITICAL();
+        return OS_ERR_WOULD_BLOCK;
+    }
+    
+#if OS_SYNC_HANDOFF
+    // Nếu chưa có, đi ngủ. Khi được đánh thức, sem_signal() đã trao
+    // thẳng đơn vị tài nguyên cho mình nên không cần kiểm tra lại.
+    return block_current_task(&sem->wait_list, timeout);
+#else
+    return sem_wait_retry(sem, timeout);
+#endif
+}
+
+void sem_wait(os_sem_t *sem) {
+    sem_wait_timeout(sem, OS_WAIT_FOREVER);
+}
+
+os_status_t sem_try_wait(os_sem_t *sem) {
+    return sem_wait_timeout(sem, OS_NO_WAIT);
 }
 
 void sem_signal(os_sem_t *sem) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_SEM_SIGNAL, sem);
+        return;
+    }
     OS_ENTER_CRITICAL();
+#if OS_SYNC_HANDOFF
+    // Có task chờ: trao trực tiếp cho task ưu tiên cao nhất, count giữ nguyên
+    if (wake_up_waiting_task(&sem->wait_list) == NULL) {
+        sem->count++;
+    }
+#else
     sem->count++;
+    wake_up_waiting_task(&sem->wait_list);
+#endif
     OS_EXIT_CRITICAL();
     
-    wake_up_waiting_task(&sem->wait_list);
+    /* Preemption: task vừa thức có ưu tiên cao hơn thì chiếm CPU ngay */
+    process_preempt_check();
+}
+
+uint32_t sem_try_wait_many(os_sem_t *sem, uint32_t max) {
+    if (!os_is_privileged()) {
+        return os_syscall2(SYS_SEM_TRY_WAIT_MANY, sem, max);
+    }
+    OS_ENTER_CRITICAL();
+    uint32_t n = (sem->count > 0) ? (uint32_t)sem->count : 0;
+    if (n > max) {
+        n = max;
+    }
+    sem->count -= (int32_t)n;
+    OS_EXIT_CRITICAL();
+    return n;
+}
+
+void sem_signal_many(os_sem_t *sem, uint32_t n) {
+    if (!os_is_privileged()) {
+        os_syscall2(SYS_SEM_SIGNAL_MANY, sem, n);
+        return;
+    }
+    if (n == 0) {
+        return;
+    }
+    OS_ENTER_CRITICAL();
+#if OS_SYNC_HANDOFF
+    // Trao lần lượt cho các waiter, phần còn lại cộng vào count
+    while (n > 0 && wake_up_waiting_task(&sem->wait_list) != NULL) {
+        n--;
+    }
+    sem->count += (int32_t)n;
+#else
+    sem->count += (int32_t)n;
+    while (n > 0 && wake_up_waiting_task(&sem->wait_list) != NULL) {
+        n--;
+    }
+#endif
+    OS_EXIT_CRITICAL();
+
+    process_preempt_check();
 }
 
 /* ============================================================
    PHẦN MUTEX (Logic hơi khác chút xíu về Owner)
    ============================================================ */
 void mutex_init(os_mutex_t* mtx){
+    mutex_init_protocol(mtx, MUTEX_PROTOCOL_INHERIT, 0);
+}
+
+void mutex_init_protocol(os_mutex_t *mtx, uint8_t protocol, uint8_t ceiling){
+    if (!os_is_privileged()) {
+        os_syscall3(SYS_MUTEX_INIT, mtx, protocol, ceiling);
+        return;
+    }
     mtx->locked = 0; //ban đầu không khóa
     mtx->owner = NULL; // chưa ai sở hữu 
     queue_init(&mtx->wait_list);
+    mtx->protocol = protocol;
+    mtx->ceiling = (ceiling < MAX_PRIORITY) ? ceiling : MAX_PRIORITY - 1;
+    mtx->next_held = NULL;
 }
 
-void mutex_lock(os_mutex_t *mtx) {
+/* Ưu tiên mà owner của mtx phải có do mtx gây ra */
+static uint8_t mutex_required_priority(os_mutex_t *mtx) {
+    uint8_t prio = 0;
+
+    if (mtx->protocol == MUTEX_PROTOCOL_CEILING) {
+        prio = mtx->ceiling;
+    }
+    // Wait list sắp theo ưu tiên: đầu danh sách là waiter cao nhất
+    PCB_t *top = mtx->wait_list.head;
+    if (mtx->protocol != MUTEX_PROTOCOL_NONE && top != NULL && top->dynamic_priority > prio) {
+        prio = top->dynamic_priority;
+    }
+    return prio;
+}
+
+/* Tính lại ưu tiên của task: max(ưu tiên gốc, yêu cầu của mọi mutex đang giữ) */
+static void mutex_update_owner_priority(PCB_t *owner) {
+    uint8_t prio = owner->static_priority;
+
+    for (os_mutex_t *m = owner->held_mutexes; m != NULL; m = m->next_held) {
+        uint8_t required = mutex_required_priority(m);
+        if (required > prio) {
+            prio = required;
+        }
+    }
+    process_set_dynamic_priority(owner, prio);
+}
+
+/* Lan truyền ưu tiên theo chuỗi: owner đang chờ mutex khác thì owner của mutex đó
+   cũng được nâng (A chờ B, B chờ C -> C chạy ở ưu tiên của A). */
+static void mutex_propagate_priority(os_mutex_t *mtx) {
+    for (int depth = 0; mtx != NULL && depth < MUTEX_MAX_INHERIT_DEPTH; depth++) {
+        PCB_t *owner = mtx->owner;
+        if (owner == NULL || mtx->protocol != MUTEX_PROTOCOL_INHERIT) {
+            return;
+        }
+
+        uint8_t old_prio = owner->dynamic_priority;
+        mutex_update_owner_priority(owner);
+        if (owner->dynamic_priority == old_prio) {
+            return; // Không đổi thì các mắt xích sau cũng không đổi
+        }
+        mtx = owner->blocked_on;
+    }
+}
+
+static void mutex_take(os_mutex_t *mtx, PCB_t *owner) {
+    mtx->locked = 1;
+    mtx->owner = owner; // Ghi nhận chủ sở hữu
+    mtx->next_held = owner->held_mutexes;
+    owner->held_mutexes = mtx;
+
+    if (mtx->protocol == MUTEX_PROTOCOL_CEILING && owner->dynamic_priority < mtx->ceiling) {
+        process_set_dynamic_priority(owner, mtx->ceiling);
+    }
+}
+
+static void mutex_release(os_mutex_t *mtx, PCB_t *owner) {
+    os_mutex_t **link = &owner->held_mutexes;
+    while (*link != NULL && *link != mtx) {
+        link = &(*link)->next_held;
+    }
+    if (*link == mtx) {
+        *link = mtx->next_held;
+    }
+    mtx->next_held = NULL;
+    mtx->locked = 0;
+    mtx->owner = NULL;
+
+    // Trả lại ưu tiên đã được kế thừa qua mutex này
+    mutex_update_owner_priority(owner);
+}
+
+// Vào wait list của mtx rồi nhường CPU. Gọi khi đang giữ OS_ENTER_CRITICAL().
+static os_status_t mutex_block_current(os_mutex_t *mtx, uint32_t timeout) {
+    // Vào wait list trước rồi mới lan truyền để waiter mới được tính
+    current_pcb->blocked_on = mtx;
+    queue_insert_by_priority(&mtx->wait_list, current_pcb);
+    process_block_current(timeout);
+    mutex_propagate_priority(mtx);
+    OS_EXIT_CRITICAL();
+
+    process_schedule();
+    return (os_status_t)current_pcb->wait_status;
+}
+
+os_status_t mutex_lock_timeout(os_mutex_t *mtx, uint32_t timeout) {
+    if (!os_is_privileged()) {
+        if (timeout == OS_NO_WAIT) {
+            return (os_status_t)os_syscall1(SYS_MUTEX_TRY_LOCK, mtx);
+        }
+        return (os_status_t)os_syscall2(SYS_MUTEX_LOCK, mtx, timeout);
+    }
+    OS_ENTER_CRITICAL();
+    if (mtx->locked == 0) {
+        mutex_take(mtx, current_pcb);
+        OS_EXIT_CRITICAL();
+        return OS_OK;
+    }
+    if (timeout == OS_NO_WAIT) {
+        OS_EXIT_CRITICAL();
+        return OS_ERR_WOULD_BLOCK;
+    }
+
+#if OS_SYNC_HANDOFF
+    // Khi chạy lại với OS_OK, mutex_unlock() đã chuyển quyền sở hữu cho mình
+    return mutex_block_current(mtx, timeout);
+#else
+    // Bản cũ: thức dậy rồi tranh lại, task khác có thể đã lấy mất
+    uint32_t start = tick_count;
+    uint32_t remaining = timeout;
     while (1) {
+        os_status_t status = mutex_block_current(mtx, remaining);
+        if (status != OS_OK) {
+            return status;
+        }
         OS_ENTER_CRITICAL();
         if (mtx->locked == 0) {
-            mtx->locked = 1;
-            mtx->owner = current_pcb; // Ghi nhận chủ sở hữu
+            mutex_take(mtx, current_pcb);
+            mutex_update_owner_priority(current_pcb); // Kế thừa từ các waiter còn lại
             OS_EXIT_CRITICAL();
-            return;
+            return OS_OK;
+        }
+        remaining = retry_remaining(start, timeout);
+        if (remaining == OS_NO_WAIT) {
+            OS_EXIT_CRITICAL();
+            return OS_ERR_TIMEOUT;
         }
-        OS_EXIT_CRITICAL();
-        
-        block_current_task(&mtx->wait_list);
     }
+#endif
+}
+
+void mutex_lock(os_mutex_t *mtx) {
+    mutex_lock_timeout(mtx, OS_WAIT_FOREVER);
+}
+
+os_status_t mutex_try_lock(os_mutex_t *mtx) {
+    return mutex_lock_timeout(mtx, OS_NO_WAIT);
+}
+
+/* Waiter đã rời wait list vì hết hạn: hạ ưu tiên owner nếu nó đang kế thừa từ waiter đó.
+   Gọi khi đã tắt ngắt. */
+void mutex_wait_aborted(os_mutex_t *mtx) {
+    mutex_propagate_priority(mtx);
 }
 
 void mutex_unlock(os_mutex_t *mtx) {
+    if (!os_is_privileged()) {
+        os_syscall1(SYS_MUTEX_UNLOCK, mtx);
+        return;
+    }
     OS_ENTER_CRITICAL();
     // Chỉ chủ sở hữu mới được mở khóa (Tính năng riêng của Mutex)
-    if (mtx->owner == current_pcb) {
-        mtx->locked = 0;
-        mtx->owner = NULL;
+    if (mtx->owner != current_pcb) {
+        OS_EXIT_CRITICAL();
+        return;
     }
+    mutex_release(mtx, current_pcb);
+
+#if OS_SYNC_HANDOFF
+    /* Trao thẳng mutex cho waiter ưu tiên cao nhất: waiter không phải tranh lại,
+       không có lần đổi ngữ cảnh thừa khi task khác chiếm khóa trước. */
+    PCB_t *t = wake_up_waiting_task(&mtx->wait_list);
+    if (t != NULL) {
+        mutex_take(mtx, t);
+        mutex_update_owner_priority(t); // Kế thừa từ các waiter còn lại
+    }
+#else
+    wake_up_waiting_task(&mtx->wait_list);
+#endif
     OS_EXIT_CRITICAL();
     
-    wake_up_waiting_task(&mtx->wait_list);
-}
\ No newline at end of file
+    // Owner có thể vừa bị hạ ưu tiên, hoặc waiter có ưu tiên cao hơn
+    process_preempt_check();
+}
+
+/* ============================================================
+   PHẦN TASK NOTIFICATION
+   ============================================================ */
+void notify_give(PCB_t *task, uint32_t value, notify_action_t action) {
+    if (!os_is_privileged()) {
+        os_syscall3(SYS_NOTIFY_GIVE, task, value, action);
+        return;
+    }
+    OS_ENTER_CRITICAL();
+    switch (action) {
+        case NOTIFY_SET:       task->notify_value = value; break;
+        case NOTIFY_INCREMENT: task->notify_value++; break;
+        case NOTIFY_SET_BITS:  task->notify_value |= value; break;
+    }
+
+    uint8_t was_waiting = (task->notify_state == NOTIFY_STATE_WAITING && task->state == PROC_BLOCKED);
+    task->notify_state = NOTIFY_STATE_PENDING;
+    if (was_waiting) {
+        process_wake_task(task, OS_OK);
+    }
+    OS_EXIT_CRITICAL();
+
+    if (was_waiting) {
+        process_preempt_check();
+    }
+}
+
+/* Chờ thông báo. Khi có, trả giá trị vào *value (nếu khác NULL) rồi xóa các bit
+   clear_bits_on_exit (0xFFFFFFFF: xóa hết). */
+os_status_t notify_wait(uint32_t clear_bits_on_exit, uint32_t *value, uint32_t timeout) {
+    if (!os_is_privileged()) {
+        if (timeout == OS_NO_WAIT) {
+            return (os_status_t)os_syscall2(SYS_NOTIFY_TRY_WAIT, clear_bits_on_exit, value);
+        }
+        return (os_status_t)os_syscall3(SYS_NOTIFY_WAIT, clear_bits_on_exit, value, timeout);
+    }
+    OS_ENTER_CRITICAL();
+    if (current_pcb->notify_state != NOTIFY_STATE_PENDING) {
+        if (timeout == OS_NO_WAIT) {
+            OS_EXIT_CRITICAL();
+            return OS_ERR_WOULD_BLOCK;
+        }
+
+        current_pcb->notify_state = NOTIFY_STATE_WAITING;
+        process_block_current(timeout);
+        OS_EXIT_CRITICAL();
+
+        process_schedule();
+
+        /* Task chờ thông báo không nằm trong wait list nào nên tick path đánh thức
+           nó với OS_OK như os_delay(): hết hạn nhận ra vì notify_give() chưa chạy */
+        OS_ENTER_CRITICAL();
+        if (current_pcb->notify_state != NOTIFY_STATE_PENDING) {
+            current_pcb->notify_state = NOTIFY_STATE_NONE;
+            OS_EXIT_CRITICAL();
+            return OS_ERR_TIMEOUT;
+        }
+    }
+
+    if (value != NULL) {
+        *value = current_pcb->notify_value;
+    }
+    current_pcb->notify_value &= ~clear_bits_on_exit;
+    current_pcb->notify_state = NOTIFY_STATE_NONE;
+    OS_EXIT_CRITICAL();
+    return OS_OK;
+}
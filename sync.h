@@ -3,6 +3,14 @@
 
 #include "process.h"
 
+/* 1: sem_signal / mutex_unlock trao thẳng tài nguyên cho waiter ưu tiên cao nhất.
+   0: bản cũ - chỉ đánh thức waiter, waiter chạy lại rồi tự tranh lại (có thể thua
+   task khác và phải chờ tiếp). Chỉ để benchmark có số "trước" trong cùng cây mã:
+   make bench BENCH_FLAGS=-DOS_SYNC_HANDOFF=0 */
+#ifndef OS_SYNC_HANDOFF
+#define OS_SYNC_HANDOFF 1
+#endif
+
 /* --- 1. SEMAPHORE --- */
 typedef struct {
     int32_t count;      // Số lượng tài nguyên
@@ -12,17 +20,53 @@ typedef struct {
 
 void sem_init(os_sem_t *sem, int32_t initial_count);
 void sem_wait(os_sem_t *sem);
+os_status_t sem_wait_timeout(os_sem_t *sem, uint32_t timeout); // timeout tính bằng tick
+os_status_t sem_try_wait(os_sem_t *sem);
 void sem_signal(os_sem_t *sem);
 
+/* Dạng theo lô: một vùng tới hạn, một lần kiểm tra preemption cho cả n đơn vị */
+uint32_t sem_try_wait_many(os_sem_t *sem, uint32_t max); // không chờ, trả về số đơn vị lấy được
+void sem_signal_many(os_sem_t *sem, uint32_t n);
+
 /* --- 2. MUTEX --- */
-typedef struct {
+/* Giao thức chống đảo ưu tiên (priority inversion) */
+#define MUTEX_PROTOCOL_NONE     0 // Không nâng ưu tiên
+#define MUTEX_PROTOCOL_INHERIT  1 // Kế thừa ưu tiên (mặc định): owner chạy ở ưu tiên của waiter cao nhất
+#define MUTEX_PROTOCOL_CEILING  2 // Trần ưu tiên: owner chạy ngay ở mức ceiling khi khóa
+
+#define MUTEX_MAX_INHERIT_DEPTH 8 // Số mắt xích tối đa khi lan truyền ưu tiên qua chuỗi mutex
+
+typedef struct os_mutex {
     int locked;         // 0: Mở, 1: Khóa
     PCB_t *owner;       // Ai đang giữ khóa? (Quan trọng cho Mutex)
     queue_t wait_list;  // Danh sách đợi
+    uint8_t protocol;   // MUTEX_PROTOCOL_*
+    uint8_t ceiling;    // Mức trần (chỉ dùng với MUTEX_PROTOCOL_CEILING)
+    struct os_mutex *next_held; // Mutex kế tiếp mà owner đang giữ
 } os_mutex_t;
 
 void mutex_init(os_mutex_t *mtx);
+void mutex_init_protocol(os_mutex_t *mtx, uint8_t protocol, uint8_t ceiling);
 void mutex_lock(os_mutex_t *mtx);
+os_status_t mutex_lock_timeout(os_mutex_t *mtx, uint32_t timeout); // timeout tính bằng tick
+os_status_t mutex_try_lock(os_mutex_t *mtx);
 void mutex_unlock(os_mutex_t *mtx);
+void mutex_wait_aborted(os_mutex_t *mtx); // scheduler gọi khi 1 waiter hết hạn chờ
+
+/* --- 3. TASK NOTIFICATION --- */
+/* Mỗi task có sẵn 1 từ thông báo trong PCB: ISR/task khác ghi vào và đánh thức
+   task chờ mà không cần semaphore hay wait list. Phù hợp khi chỉ có 1 task chờ. */
+#define NOTIFY_STATE_NONE     0 // Không có gì
+#define NOTIFY_STATE_WAITING  1 // Task đang chặn trong notify_wait()
+#define NOTIFY_STATE_PENDING  2 // Có thông báo chưa được đọc
+
+typedef enum {
+    NOTIFY_SET,        // notify_value = value
+    NOTIFY_INCREMENT,  // notify_value++ (dùng như semaphore đếm)
+    NOTIFY_SET_BITS    // notify_value |= value (dùng như event flags)
+} notify_action_t;
+
+void notify_give(PCB_t *task, uint32_t value, notify_action_t action); // Gọi được từ ISR
+os_status_t notify_wait(uint32_t clear_bits_on_exit, uint32_t *value, uint32_t timeout);
 
 #endif
\ No newline at end of file
@@ -5,21 +5,145 @@
 #define SYSTICK_CTRL   (*(volatile uint32_t*)(SYSTICK_BASE + 0x00))
 #define SYSTICK_LOAD   (*(volatile uint32_t*)(SYSTICK_BASE + 0x04))
 #define SYSTICK_VAL    (*(volatile uint32_t*)(SYSTICK_BASE + 0x08))
-#define ICSR           (*(volatile uint32_t*)(0xE000ED04))
-#define PENDSVSET      (1 << 28)
+
+#define SCB_SHPR3      (*(volatile uint32_t*)0xE000ED20) // ưu tiên PendSV [23:16], SysTick [31:24]
+#define SCB_ICSR       (*(volatile uint32_t*)0xE000ED04)
+
+#define SCB_ICSR_PENDSTCLR      (1UL << 25)     // xóa ngắt SysTick đang chờ
+#define SCB_ICSR_VECTPENDING    (0x1FFUL << 12) // exception đang chờ có ưu tiên cao nhất (0: không có)
+
+#define SYSTICK_CTRL_ENABLE     (1UL << 0)
+#define SYSTICK_CTRL_COUNTFLAG  (1UL << 16) // đã đếm về 0 kể từ lần đọc trước (đọc sẽ xóa)
+#define SYSTICK_MAX_LOAD        0x00FFFFFFUL // bộ đếm 24 bit
+
+static uint32_t systick_period = 0;        // số xung clock cho 1 tick
+static uint32_t max_suppressed_ticks = 0;  // số tick tối đa của 1 chặng ngủ (1 lần nạp 24 bit)
+static volatile uint32_t skipped_ticks = 0;
 
 void systick_init(uint32_t ticks) 
 {
+    systick_period = ticks;
+    max_suppressed_ticks = SYSTICK_MAX_LOAD / ticks;
+
+    // SysTick và PendSV ở mức thấp nhất để không chen ngang các ISR khác
+    SCB_SHPR3 = (SCB_SHPR3 & 0x0000FFFFUL) |
+                ((uint32_t)OS_KERNEL_INTERRUPT_PRIORITY << 16) |
+                ((uint32_t)OS_KERNEL_INTERRUPT_PRIORITY << 24);
+
     SYSTICK_LOAD = ticks - 1;
     SYSTICK_VAL  = 0;
     SYSTICK_CTRL = 0x07;  // enable, interrupt, processor clock
 }
 
+/* Tickless idle: khi chỉ còn idle task chạy được, nạp SysTick tới deadline
+   của task ngủ sớm nhất rồi WFI, thức dậy thì bù số tick đã trôi qua.
+   Bộ đếm 24 bit chỉ chứa được max_suppressed_ticks tick (2 tick với SYSTICK_RATE
+   8 000 000), nên giấc ngủ dài được nối thành nhiều chặng: mỗi lần về 0 giữa
+   chừng, idle tự cộng tick của chặng đó, xóa ngắt SysTick đang chờ và WFI tiếp.
+   Dùng PRIMASK (cpsid i) thay cho OS_ENTER_CRITICAL(): ngắt bị BASEPRI che
+   sẽ không đánh thức được WFI, còn ngắt bị PRIMASK che thì vẫn đánh thức. */
+void systick_tickless_idle(void)
+{
+    if (!os_is_privileged()) {
+        os_syscall0(SYS_IDLE);
+        return;
+    }
+    __asm volatile ("cpsid i" : : : "memory");
+
+    uint32_t remaining = process_idle_expected_ticks();
+    if (remaining < OS_TICKLESS_MIN_IDLE_TICKS) {
+        __asm volatile ("cpsie i" : : : "memory");
+        __asm volatile ("wfi");
+        return;
+    }
+
+    /* Chặng đầu: phần còn lại của tick hiện tại vẫn được tính */
+    uint32_t chunk = (remaining < max_suppressed_ticks) ? remaining : max_suppressed_ticks;
+    SYSTICK_CTRL &= ~SYSTICK_CTRL_ENABLE;
+    uint32_t val0 = SYSTICK_VAL;
+    uint32_t span = val0 + (chunk - 1) * systick_period;
+    /* Phần tick hiện tại đã trôi trước khi vào idle: chặng đầu không bắt đầu ở biên
+       tick. VAL = 0: tick đó đã xong và ngắt SysTick đang chờ sẽ tự cộng */
+    uint32_t offset = val0 ? systick_period - val0 : 0;
+    SYSTICK_LOAD = span - 1;
+    SYSTICK_VAL = 0;
+    SYSTICK_CTRL |= SYSTICK_CTRL_ENABLE;
+
+    uint32_t completed = 0;
+    uint32_t next_load = 0; // 0: thức sớm, tính lại phần lẻ bên dưới
+    while (1) {
+        /* Nạp sẵn độ dài chặng sau: LOAD mới chỉ có hiệu lực ở lần về 0 kế tiếp */
+        uint32_t next_chunk = remaining - chunk;
+        if (next_chunk > max_suppressed_ticks) {
+            next_chunk = max_suppressed_ticks;
+        }
+        if (next_chunk > 0) {
+            SYSTICK_LOAD = next_chunk * systick_period - 1;
+        }
+
+        /* Ngắt đang bị che vẫn đánh thức được WFI, chỉ chưa được phục vụ */
+        __asm volatile ("dsb" : : : "memory");
+        __asm volatile ("wfi");
+        __asm volatile ("isb" : : : "memory");
+
+        uint32_t ctrl = SYSTICK_CTRL;   // đọc 1 lần: COUNTFLAG bị xóa sau khi đọc
+        if (!(ctrl & SYSTICK_CTRL_COUNTFLAG)) {
+            break;                      // ngắt khác đánh thức giữa chặng
+        }
+
+        if (next_chunk == 0) {
+            /* Ngủ đủ tới deadline: ngắt SysTick đang chờ sẽ cộng tick cuối cùng */
+            SYSTICK_CTRL = ctrl & ~SYSTICK_CTRL_ENABLE;
+            uint32_t overshoot = (span - 1) - SYSTICK_VAL;
+            completed += chunk - 1;
+            next_load = (overshoot < systick_period) ? systick_period - overshoot : systick_period;
+            break;
+        }
+
+        /* Hết một chặng giữa chừng: tự cộng tick, bộ đếm đã chạy sang chặng sau */
+        completed += chunk;
+        remaining -= chunk;
+        chunk = next_chunk;
+        span = next_chunk * systick_period;
+        offset = 0;                     // các chặng sau bắt đầu đúng biên tick
+        SCB_ICSR = SCB_ICSR_PENDSTCLR;
+        if (SCB_ICSR & SCB_ICSR_VECTPENDING) {
+            break;                      // có ngắt khác đang chờ: dừng ở đầu chặng mới
+        }
+    }
+
+    if (next_load == 0) {
+        /* Thức sớm: chỉ tính các tick đã trọn vẹn, kể từ biên tick trước chặng */
+        SYSTICK_CTRL &= ~SYSTICK_CTRL_ENABLE;
+        uint32_t elapsed = offset + (span - SYSTICK_VAL);
+        completed += elapsed / systick_period;
+        next_load = (elapsed / systick_period + 1) * systick_period - elapsed;
+    }
+
+    /* Chạy nốt phần lẻ của tick hiện tại, sau đó quay lại chu kỳ bình thường */
+    SYSTICK_LOAD = next_load - 1;
+    SYSTICK_VAL = 0;
+    SYSTICK_CTRL |= SYSTICK_CTRL_ENABLE;
+    SYSTICK_LOAD = systick_period - 1;
+
+    process_step_tick(completed);
+    skipped_ticks += completed;
+
+    __asm volatile ("cpsie i" : : : "memory");
+}
+
+uint32_t systick_get_skipped_ticks(void)
+{
+    return skipped_ticks;
+}
+
+uint32_t systick_get_period(void)
+{
+    return systick_period;
+}
+
 void SysTick_Handler(void) 
 {
-    // cập nhật giờ đánh thức
+    // cập nhật giờ đánh thức, round-robin; tự gọi process_schedule() khi cần đổi task
     process_timer_tick();
-
-    process_schedule();
-    ICSR |= PENDSVSET; // set cờ PendSV
 }
@@ -4,5 +4,8 @@
 #include <stdint.h>
 
 void systick_init(uint32_t ticks);
+void systick_tickless_idle(void);             // gọi từ idle task: ngủ tới lần thức dậy gần nhất
+uint32_t systick_get_skipped_ticks(void);     // số tick đã bỏ qua nhờ tickless idle
+uint32_t systick_get_period(void);            // số chu kỳ CPU cho 1 tick
 
 #endif
@@ -5,6 +5,9 @@
 #include "ipc.h"
 #include "uart.h"
 #include "banker.h"
+#include "systick.h"
+#include "memory.h"
+#include "pool.h"
 #include <stdint.h>
 
 /* Biến toàn cục */
@@ -15,7 +18,9 @@ extern os_msg_queue_t temp_queue;
 extern os_mutex_t mutex_A;
 extern os_mutex_t mutex_B;
 
-/* TASK 1: SENSOR */
+/* TASK 1: SENSOR
+   Mô phỏng cảm biến bằng os_delay (cây này chưa có ISR cảm biến). temp_queue là
+   hàng đợi SPSC: display chờ bằng notify_wait, sensor đánh thức bằng notify_give */
 void task_sensor_update(void) {
     int local_temp = 25; 
     int direction = 1; 
@@ -107,6 +112,8 @@ void task_logger(void) {
     }
 }
 
+#define TOP_SAMPLE_TICKS 10 // cửa sổ đo của lệnh 'top' (1s với tick 10Hz)
+
 // Hàm so sánh chuỗi đơn giản
 int my_strcmp(const char *s1, const char *s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -147,6 +154,13 @@ void task_shell(void) {
                 uart_print("Available commands:\r\n");
                 uart_print("  help  : Show this help\r\n");
                 uart_print("  temp  : Show current temperature\r\n");
+                uart_print("  tickless: Show ticks skipped by tickless idle\r\n");
+                uart_print("  top   : CPU usage per task over 1s\r\n");
+                uart_print("  irqoff: Longest interrupts-off windows per call site\r\n");
+                uart_print("  stack : Stack high-water mark per task\r\n");
+                uart_print("  pool  : Fixed-size pool usage\r\n");
+                uart_print("  heap  : Heap statistics and usage per task\r\n");
+                uart_print("  irqoff reset: Clear irqoff statistics\r\n");
                 uart_print("  reboot: Restart system\r\n");
             } 
             else if (my_strcmp(cmd_buffer, "temp") == 0) {
@@ -154,10 +168,40 @@ void task_shell(void) {
                 uart_print_dec(current_temperature);
                 uart_print(" C\r\n");
             }
+            else if (my_strcmp(cmd_buffer, "tickless") == 0) {
+                uart_print("Skipped ticks: ");
+                uart_print_dec(systick_get_skipped_ticks());
+                uart_print(" / uptime ticks: ");
+                uart_print_dec(tick_count);
+                uart_print("\r\n");
+            }
+            else if (my_strcmp(cmd_buffer, "top") == 0) {
+                // Không giữ app_mutex trong lúc chờ lấy mẫu
+                mutex_unlock(&app_mutex);
+                process_top_begin();
+                os_delay(TOP_SAMPLE_TICKS);
+                mutex_lock(&app_mutex);
+                process_print_top();
+            }
+            else if (my_strcmp(cmd_buffer, "stack") == 0) {
+                process_print_stacks();
+            }
+            else if (my_strcmp(cmd_buffer, "heap") == 0) {
+                os_heap_print();
+            }
+            else if (my_strcmp(cmd_buffer, "pool") == 0) {
+                os_pool_print();
+            }
+            else if (my_strcmp(cmd_buffer, "irqoff") == 0) {
+                crit_profile_dump();
+            }
+            else if (my_strcmp(cmd_buffer, "irqoff reset") == 0) {
+                crit_profile_reset();
+                uart_print("irqoff statistics cleared\r\n");
+            }
             else if (my_strcmp(cmd_buffer, "reboot") == 0) {
                 uart_print("Rebooting...\r\n");
-                // Reset bằng cách ghi vào AIRCR của SCB
-                *(volatile uint32_t*)0xE000ED0C = 0x05FA0004;
+                os_reboot();
             }
             else if (cmd_index > 0) {
                 uart_print("Unknown command: ");
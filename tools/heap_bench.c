@@ -0,0 +1,253 @@
+/* Benchmark heap trên máy host: replay cùng một trace cấp phát trên
+   - first-fit cũ (bản sao thuật toán trước khi chuyển sang TLSF)
+   - TLSF trong memory.c (build với -DOS_HOST_BENCH)
+   và in số lần cấp phát thất bại, độ phân mảnh, thời gian malloc/free.
+
+   make heap-bench
+   LƯU Ý: trên host 64 bit header block lớn gấp đôi so với Cortex-M3,
+   nên số tuyệt đối chỉ dùng để so sánh hai thuật toán với nhau. */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "memory.h"
+
+void os_heap_host_walk(void (*visit)(void *ptr, size_t size, int is_free));
+
+#define ARENA_SIZE   (HEAP_SIZE)  // host build: TLSF dùng trọn heap_area (không có vùng stack)
+#define TRACE_OPS    20000
+#define MAX_LIVE     96
+
+/* ============================================================
+   1. FIRST-FIT CŨ (logic của memory.c trước TLSF)
+   ============================================================ */
+typedef struct ff_block {
+    struct ff_block *next;
+    size_t size;
+    uint8_t is_free;
+} ff_block_t;
+
+static uint8_t ff_area[ARENA_SIZE] __attribute__((aligned(4096)));
+static ff_block_t *ff_list;
+static uint32_t ff_steps, ff_max_steps; // số block đã duyệt trong 1 lần gọi
+
+static void ff_init(void)
+{
+    ff_list = (ff_block_t *)ff_area;
+    ff_list->next = NULL;
+    ff_list->size = ARENA_SIZE - sizeof(ff_block_t);
+    ff_list->is_free = 1;
+}
+
+static void *ff_malloc_aligned(size_t size, size_t alignment)
+{
+    if (alignment < 8) alignment = 8;
+    size = (size + 7) & ~(size_t)7;
+    void *ptr = NULL;
+
+    ff_steps = 0;
+    ff_block_t *current = ff_list;
+    while (current) {
+        ff_steps++;
+        if (current->is_free && current->size >= size) {
+            uintptr_t data_addr = (uintptr_t)current + sizeof(ff_block_t);
+            uintptr_t aligned_addr = (data_addr + alignment - 1) & ~(uintptr_t)(alignment - 1);
+            size_t padding = aligned_addr - data_addr;
+            if (current->size >= size + padding) {
+                if (padding >= sizeof(ff_block_t) + 8) {
+                    ff_block_t *padding_block = current;
+                    ff_block_t *aligned_block = (ff_block_t *)(aligned_addr - sizeof(ff_block_t));
+                    // Bản gốc ghi padding_block (chính là current) trước rồi mới đọc
+                    // current->size/next -> size tràn số, list thành vòng; ở đây
+                    // khởi tạo aligned_block trước để baseline chạy được
+                    aligned_block->size = current->size - padding;
+                    aligned_block->is_free = 1;
+                    aligned_block->next = current->next;
+                    padding_block->size = padding - sizeof(ff_block_t);
+                    padding_block->is_free = 0;
+                    padding_block->next = aligned_block;
+                    current = aligned_block;
+                    data_addr = aligned_addr;
+                } else if (padding > 0) {
+                    current = current->next;
+                    continue;
+                }
+                if (current->size > size + sizeof(ff_block_t) + 8) {
+                    ff_block_t *nb = (ff_block_t *)((uint8_t *)current + sizeof(ff_block_t) + size);
+                    nb->size = current->size - size - sizeof(ff_block_t);
+                    nb->is_free = 1;
+                    nb->next = current->next;
+                    current->size = size;
+                    current->next = nb;
+                }
+                current->is_free = 0;
+                ptr = (void *)data_addr;
+                break;
+            }
+        }
+        current = current->next;
+    }
+    if (ff_steps > ff_max_steps) ff_max_steps = ff_steps;
+    return ptr;
+}
+
+static void ff_free(void *ptr)
+{
+    if (ptr == NULL) return;
+    ff_block_t *block = (ff_block_t *)((uint8_t *)ptr - sizeof(ff_block_t));
+    block->is_free = 1;
+    ff_block_t *current = ff_list;
+    while (current && current->next != block) {
+        current = current->next;
+    }
+    if (block->next && block->next->is_free) {
+        block->size += sizeof(ff_block_t) + block->next->size;
+        block->next = block->next->next;
+    }
+}
+
+static void ff_walk(void (*visit)(void *ptr, size_t size, int is_free))
+{
+    for (ff_block_t *b = ff_list; b; b = b->next) {
+        visit((uint8_t *)b + sizeof(ff_block_t), b->size, b->is_free);
+    }
+}
+
+/* ============================================================
+   2. BỘ CẤP PHÁT ĐANG ĐO
+   ============================================================ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void *(*alloc)(size_t size, size_t alignment);
+    void (*release)(void *ptr);
+    void (*walk)(void (*visit)(void *, size_t, int));
+} allocator_t;
+
+static const allocator_t allocators[] = {
+    { "first-fit", ff_init,     ff_malloc_aligned, ff_free, ff_walk },
+    { "tlsf     ", os_mem_init, os_malloc_aligned, os_free, os_heap_host_walk },
+};
+
+/* ============================================================
+   3. TRACE: sinh giả ngẫu nhiên (LCG) nên mọi lần chạy giống nhau
+   ============================================================ */
+typedef enum { TRACE_MIXED, TRACE_ALIGNED, TRACE_BURST } trace_kind_t;
+static const char *trace_names[] = { "mixed sizes", "mixed + MPU-aligned", "bursts of frames" };
+
+static uint32_t lcg_state;
+static uint32_t lcg(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state >> 8;
+}
+
+static size_t trace_size(trace_kind_t kind)
+{
+    uint32_t r = lcg() % 100;
+    if (kind == TRACE_BURST) {
+        return (r < 80) ? 256 + lcg() % 256 : 16 + lcg() % 48; // khung cảm biến + vài object nhỏ
+    }
+    if (r < 70) return 8 + lcg() % 120;
+    if (r < 95) return 128 + lcg() % 384;
+    return 512 + lcg() % 1536;
+}
+
+static size_t trace_alignment(trace_kind_t kind)
+{
+    if (kind == TRACE_ALIGNED && lcg() % 100 < 20) {
+        return (size_t)256 << (lcg() % 3); // 256 / 512 / 1024 như region MPU
+    }
+    return 8;
+}
+
+typedef struct {
+    uint32_t allocs, fails, frees;
+    double alloc_ns, free_ns, alloc_max_ns, free_max_ns;
+    size_t free_bytes, largest_free;
+    uint32_t free_blocks;
+} result_t;
+
+static result_t *walk_result;
+static void walk_visit(void *ptr, size_t size, int is_free)
+{
+    (void)ptr;
+    if (!is_free) return;
+    walk_result->free_bytes += size;
+    walk_result->free_blocks++;
+    if (size > walk_result->largest_free) walk_result->largest_free = size;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_trace(const allocator_t *a, trace_kind_t kind, result_t *res)
+{
+    void *live[MAX_LIVE];
+    memset(live, 0, sizeof(live));
+    memset(res, 0, sizeof(*res));
+    lcg_state = 12345u + kind;
+    a->init();
+
+    for (int op = 0; op < TRACE_OPS; op++) {
+        int slot = lcg() % MAX_LIVE;
+        double t0, dt;
+
+        if (live[slot] == NULL) {
+            size_t size = trace_size(kind);
+            size_t alignment = trace_alignment(kind);
+            t0 = now_ns();
+            live[slot] = a->alloc(size, alignment);
+            dt = now_ns() - t0;
+            res->allocs++;
+            res->alloc_ns += dt;
+            if (dt > res->alloc_max_ns) res->alloc_max_ns = dt;
+            if (live[slot] == NULL) {
+                res->fails++;
+            } else if (((uintptr_t)live[slot] & (alignment - 1)) != 0) {
+                printf("  !! %s returned misaligned block\n", a->name);
+            }
+        } else {
+            t0 = now_ns();
+            a->release(live[slot]);
+            dt = now_ns() - t0;
+            live[slot] = NULL;
+            res->frees++;
+            res->free_ns += dt;
+            if (dt > res->free_max_ns) res->free_max_ns = dt;
+        }
+    }
+
+    walk_result = res;
+    a->walk(walk_visit);
+}
+
+int main(void)
+{
+    printf("Heap trace replay: %d ops, %d live slots, %d byte arena\n\n", TRACE_OPS, MAX_LIVE, ARENA_SIZE);
+
+    for (int t = 0; t < 3; t++) {
+        printf("[%s]\n", trace_names[t]);
+        printf("  allocator   fails/allocs  malloc avg/max ns  free avg/max ns  free B  largest  frag  blocks\n");
+        for (unsigned i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+            result_t r;
+            ff_max_steps = 0;
+            run_trace(&allocators[i], (trace_kind_t)t, &r);
+            unsigned frag = r.free_bytes ? (unsigned)(100 - r.largest_free * 100 / r.free_bytes) : 0;
+            printf("  %s  %5u/%-6u  %7.0f/%-8.0f   %6.0f/%-8.0f  %6zu  %7zu  %3u%%  %u\n",
+                   allocators[i].name, r.fails, r.allocs,
+                   r.alloc_ns / (r.allocs ? r.allocs : 1), r.alloc_max_ns,
+                   r.free_ns / (r.frees ? r.frees : 1), r.free_max_ns,
+                   r.free_bytes, r.largest_free, frag, r.free_blocks);
+            if (i == 0) {
+                printf("             (first-fit walked up to %u blocks in one call)\n", ff_max_steps);
+            }
+        }
+        printf("\n");
+    }
+    return 0;
+}
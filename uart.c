@@ -9,6 +9,9 @@
 #define UART0_ICR (*(volatile uint32_t*)(UART0_BASE + 0x044)) // ghi 1 để xóa cờ ngắt
 
 #define NVIC_EN0 (*(volatile uint32_t*)0xE000E100) // bật ngắt cho ngoại vi, thanh ghi enable interrupt của NVIC (arm cortex - M)
+#define NVIC_IPR_UART0 (*(volatile uint8_t*)(0xE000E400 + 5)) // byte ưu tiên của IRQ5 (UART0)
+
+#define UART0_IRQ_PRIORITY 0xA0 // ISR gọi notify_give() -> phải >= OS_MAX_SYSCALL_INTERRUPT_PRIORITY
 
 #define UART_RXFE      (1 << 4) // FIFO Empty -> ko có dữ liệu đọc
 #define UART_TXFF      (1 << 5) // FIFO full -> ko thể ghi thêm dữ liệu
@@ -19,11 +22,11 @@ static char rx_bufferr[RX_BUFFER_SIZE];
 static int rx_head = 0; //  vị trí ghi
 static int rx_tail = 0; // vị trí đọc
 
-os_sem_t uart_rx_semaphore; 
+static PCB_t *volatile rx_waiter = NULL; // task đang đọc UART (nhận notification từ ISR)
 
 void uart_init(void) {
-    sem_init(&uart_rx_semaphore, 0); // giá trị ban đầu là 0 , chưa có dữ liệu uart
     UART0_IM |= UART_RXIM;
+    NVIC_IPR_UART0 = UART0_IRQ_PRIORITY;
     NVIC_EN0 |= (1 << 5); 
 }
 
@@ -58,6 +61,8 @@ void uart_print_dec(uint32_t val) {
 }
 
 void UART0_Handler(void) {
+    int received = 0;
+
     UART0_ICR |= UART_RXIM;
     while((UART0_FR & UART_RXFE) == 0){
         char c = (char)(UART0_DR & 0xFF);
@@ -65,22 +70,35 @@ void UART0_Handler(void) {
         if (next_head != rx_tail) {
             rx_bufferr[rx_head] = c;
             rx_head = next_head;
-            sem_signal(&uart_rx_semaphore);
+            received = 1;
         }
     }
+
+    // Chỉ 1 notification cho cả loạt byte, thay vì 1 lần sem_signal mỗi byte
+    if (received && rx_waiter != NULL) {
+        notify_give(rx_waiter, 0, NOTIFY_INCREMENT);
+    }
 }
 
 
 char uart_getc(void) {
-    sem_wait(&uart_rx_semaphore);
-    OS_ENTER_CRITICAL();
-
-    char c = rx_bufferr[rx_tail];
-    rx_tail = (rx_tail + 1) % RX_BUFFER_SIZE;
-
-    OS_EXIT_CRITICAL();
+    if (!os_is_privileged()) {
+        return (char)os_syscall0(SYS_UART_GETC);
+    }
+    while (1) {
+        OS_ENTER_CRITICAL();
+        if (rx_head != rx_tail) {
+            char c = rx_bufferr[rx_tail];
+            rx_tail = (rx_tail + 1) % RX_BUFFER_SIZE;
+            OS_EXIT_CRITICAL();
+            return c;
+        }
+        rx_waiter = current_pcb;
+        OS_EXIT_CRITICAL();
 
-    return c;
+        // Nếu ISR gửi thông báo ngay sau khi thoát critical, notify_wait trả về luôn
+        notify_wait(0xFFFFFFFFUL, NULL, OS_WAIT_FOREVER);
+    }
 }
 
 // Hàm phụ trợ để chuyển số 0-15 thành ký tự '0'-'F'